@@ -0,0 +1,267 @@
+#include "AnchorDiff.h"
+#include "TokenMatch.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t kNoOccurrence = UINT32_MAX;
+
+struct Occurrences {
+    uint32_t from_count = 0;
+    uint32_t to_count = 0;
+    uint32_t from_id = 0;
+    uint32_t to_id = 0;
+};
+
+// Якоря, найденные в диапазоне: совпадающие отрезки по возрастанию позиций.
+// Если якорей нет, диапазон либо отдается Майерсу, либо целиком заменяется.
+struct Anchors {
+    std::vector<DiffSegment> snakes;
+    bool use_myers = false;
+};
+
+// Уникальные общие токены диапазона в порядке from, отобранные по наибольшей
+// возрастающей подпоследовательности позиций в to (сортировка пасьянсом)
+std::vector<std::pair<uint32_t, uint32_t>> GetUniqueAnchors(const TokenId* from_tokens,
+                                                            const TokenId* to_tokens,
+                                                            const DiffSegment& range) {
+    std::unordered_map<TokenId, Occurrences> occurrences;
+    for (uint32_t id = range.from_left; id < range.from_right; ++id) {
+        auto& entry = occurrences[from_tokens[id]];
+        ++entry.from_count;
+        entry.from_id = id;
+    }
+    for (uint32_t id = range.to_left; id < range.to_right; ++id) {
+        auto it = occurrences.find(to_tokens[id]);
+        if (it != occurrences.end()) {
+            ++it->second.to_count;
+            it->second.to_id = id;
+        }
+    }
+    
+    std::vector<std::pair<uint32_t, uint32_t>> candidates;
+    for (uint32_t id = range.from_left; id < range.from_right; ++id) {
+        const auto& entry = occurrences[from_tokens[id]];
+        if (entry.from_count == 1 && entry.to_count == 1) {
+            candidates.emplace_back(id, entry.to_id);
+        }
+    }
+    
+    // tails[k] - кандидат с наименьшей позицией в to, которым заканчивается
+    // возрастающая цепочка длины k + 1
+    std::vector<uint32_t> tails;
+    std::vector<int32_t> previous(candidates.size(), -1);
+    for (uint32_t i = 0; i < candidates.size(); ++i) {
+        auto it = std::lower_bound(tails.begin(), tails.end(), candidates[i].second,
+                                   [&](uint32_t tail, uint32_t to_id) {
+                                       return candidates[tail].second < to_id;
+                                   });
+        if (it != tails.begin()) {
+            previous[i] = *(it - 1);
+        }
+        if (it == tails.end()) {
+            tails.push_back(i);
+        } else {
+            *it = i;
+        }
+    }
+    
+    std::vector<std::pair<uint32_t, uint32_t>> anchors(tails.size());
+    int32_t current = tails.empty() ? -1 : tails.back();
+    for (size_t i = anchors.size(); i > 0; --i) {
+        anchors[i - 1] = candidates[current];
+        current = previous[current];
+    }
+    return anchors;
+}
+
+// Самый редкий общий отрезок диапазона, как в histogram diff из git: from
+// индексируется цепочками вхождений, каждое вхождение токена из to
+// расширяется в обе стороны до отрезка, у отрезка считается наименьшее
+// число вхождений его токенов в from
+Anchors GetHistogramAnchor(const TokenId* from_tokens, const TokenId* to_tokens,
+                           const DiffSegment& range, uint32_t max_chain_length) {
+    struct Chain {
+        uint32_t count = 0;
+        uint32_t last = kNoOccurrence;
+    };
+    std::unordered_map<TokenId, Chain> index;
+    std::vector<uint32_t> previous(range.from_right - range.from_left);
+    for (uint32_t id = range.from_left; id < range.from_right; ++id) {
+        auto& chain = index[from_tokens[id]];
+        previous[id - range.from_left] = chain.last;
+        chain.last = id;
+        ++chain.count;
+    }
+    auto count = [&](uint32_t from_id) { return index.find(from_tokens[from_id])->second.count; };
+    
+    Anchors anchors;
+    bool has_common = false;
+    uint32_t best_count = max_chain_length + 1;
+    DiffSegment best{0, 0, 0, 0, true};
+    
+    for (uint32_t to_id = range.to_left; to_id < range.to_right;) {
+        auto it = index.find(to_tokens[to_id]);
+        if (it == index.end()) {
+            ++to_id;
+            continue;
+        }
+        has_common = true;
+        
+        const Chain& chain = it->second;
+        if (chain.count > best_count || chain.count > max_chain_length) {
+            ++to_id;
+            continue;
+        }
+        
+        uint32_t next_to_id = to_id + 1;
+        for (uint32_t from_id = chain.last; from_id != kNoOccurrence;
+             from_id = previous[from_id - range.from_left]) {
+            DiffSegment region{from_id, from_id + 1, to_id, to_id + 1, true};
+            uint32_t region_count = chain.count;
+            
+            while (region.from_left > range.from_left && region.to_left > range.to_left &&
+                   from_tokens[region.from_left - 1] == to_tokens[region.to_left - 1]) {
+                --region.from_left;
+                --region.to_left;
+                region_count = std::min(region_count, count(region.from_left));
+            }
+            while (region.from_right < range.from_right && region.to_right < range.to_right &&
+                   from_tokens[region.from_right] == to_tokens[region.to_right]) {
+                region_count = std::min(region_count, count(region.from_right));
+                ++region.from_right;
+                ++region.to_right;
+            }
+            
+            // Отрезки внутри найденного заново не перебираются
+            next_to_id = std::max(next_to_id, region.to_right);
+            if (best.from_right - best.from_left < region.from_right - region.from_left ||
+                region_count < best_count) {
+                best = region;
+                best_count = region_count;
+            }
+        }
+        to_id = next_to_id;
+    }
+    
+    if (best.from_right > best.from_left) {
+        anchors.snakes.push_back(best);
+    } else {
+        // Общие токены есть, но все встречаются слишком часто
+        anchors.use_myers = has_common;
+    }
+    return anchors;
+}
+
+// Общая схема: у диапазона отрезаются общие начало и конец, середина делится
+// якорями, промежутки между якорями обрабатываются так же. Стек обходится
+// с конца, поэтому части диапазона кладутся справа налево.
+template <typename FindAnchors>
+std::vector<DiffSegment> GetAnchorSegments(const TokenId* from_tokens, uint32_t from_size,
+                                           const TokenId* to_tokens, uint32_t to_size,
+                                           FindAnchors find_anchors) {
+    std::vector<DiffSegment> segments;
+    
+    std::vector<DiffSegment> tasks{{0, from_size, 0, to_size, false}};
+    while (!tasks.empty()) {
+        DiffSegment task = tasks.back();
+        tasks.pop_back();
+        
+        if (task.is_snake) {
+            segments.push_back(task);
+            continue;
+        }
+        
+        uint32_t common_size = std::min(task.from_right - task.from_left, task.to_right - task.to_left);
+        uint32_t prefix = CommonPrefixLength(from_tokens + task.from_left, to_tokens + task.to_left,
+                                             common_size);
+        uint32_t suffix = CommonSuffixLength(from_tokens + task.from_right, to_tokens + task.to_right,
+                                             common_size - prefix);
+        
+        // Все, что левее задачи, уже выведено, поэтому префикс выводится сразу
+        if (prefix > 0) {
+            segments.push_back({task.from_left, task.from_left + prefix,
+                                task.to_left, task.to_left + prefix, true});
+        }
+        if (suffix > 0) {
+            tasks.push_back({task.from_right - suffix, task.from_right,
+                             task.to_right - suffix, task.to_right, true});
+        }
+        
+        DiffSegment middle{task.from_left + prefix, task.from_right - suffix,
+                           task.to_left + prefix, task.to_right - suffix, false};
+        if (middle.from_left == middle.from_right || middle.to_left == middle.to_right) {
+            continue;
+        }
+        
+        Anchors anchors = find_anchors(middle);
+        if (anchors.snakes.empty()) {
+            if (anchors.use_myers) {
+                segments.push_back(middle);
+            }
+            continue;
+        }
+        
+        uint32_t from_right = middle.from_right;
+        uint32_t to_right = middle.to_right;
+        for (auto it = anchors.snakes.rbegin(); it != anchors.snakes.rend(); ++it) {
+            tasks.push_back({it->from_right, from_right, it->to_right, to_right, false});
+            tasks.push_back(*it);
+            from_right = it->from_left;
+            to_right = it->to_left;
+        }
+        tasks.push_back({middle.from_left, from_right, middle.to_left, to_right, false});
+    }
+    
+    return segments;
+}
+
+}  // namespace
+
+std::vector<DiffSegment> GetPatienceSegments(const TokenId* from_tokens, uint32_t from_size,
+                                             const TokenId* to_tokens, uint32_t to_size) {
+    return GetAnchorSegments(from_tokens, from_size, to_tokens, to_size, [&](const DiffSegment& range) {
+        Anchors anchors;
+        for (auto [from_id, to_id] : GetUniqueAnchors(from_tokens, to_tokens, range)) {
+            anchors.snakes.push_back({from_id, from_id + 1, to_id, to_id + 1, true});
+        }
+        // Зацепиться не за что: диапазон целиком достается Майерсу
+        anchors.use_myers = anchors.snakes.empty();
+        return anchors;
+    });
+}
+
+std::vector<DiffSegment> GetHistogramSegments(const TokenId* from_tokens, uint32_t from_size,
+                                              const TokenId* to_tokens, uint32_t to_size,
+                                              uint32_t max_chain_length) {
+    return GetAnchorSegments(from_tokens, from_size, to_tokens, to_size, [&](const DiffSegment& range) {
+        return GetHistogramAnchor(from_tokens, to_tokens, range, max_chain_length);
+    });
+}
+
+std::vector<DiffSegment> GetUniqueAnchorChunks(const TokenId* from_tokens, uint32_t from_size,
+                                               const TokenId* to_tokens, uint32_t to_size,
+                                               uint32_t min_chunk_size) {
+    std::vector<DiffSegment> segments;
+    uint32_t from_left = 0;
+    uint32_t to_left = 0;
+    
+    for (auto [from_id, to_id] : GetUniqueAnchors(from_tokens, to_tokens, {0, from_size, 0, to_size, false})) {
+        if ((from_id - from_left) + (to_id - to_left) < min_chunk_size) {
+            continue;
+        }
+        if (from_left < from_id && to_left < to_id) {
+            segments.push_back({from_left, from_id, to_left, to_id, false});
+        }
+        segments.push_back({from_id, from_id + 1, to_id, to_id + 1, true});
+        from_left = from_id + 1;
+        to_left = to_id + 1;
+    }
+    
+    if (from_left < from_size && to_left < to_size) {
+        segments.push_back({from_left, from_size, to_left, to_size, false});
+    }
+    return segments;
+}
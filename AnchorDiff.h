@@ -0,0 +1,36 @@
+#pragma once
+
+#include "UniversalTokenizer.h"
+#include <vector>
+
+// Отрезок разбиения окна [0, from_size) x [0, to_size): либо совпадающая
+// змейка, либо диапазон, который досчитывается алгоритмом Майерса
+struct DiffSegment {
+    uint32_t from_left;
+    uint32_t from_right;
+    uint32_t to_left;
+    uint32_t to_right;
+    bool is_snake;
+};
+
+// Patience diff: окно делится по наибольшей возрастающей последовательности
+// токенов, встречающихся ровно один раз в каждой из сторон. Диапазоны без
+// таких токенов отдаются Майерсу, диапазоны с одной пустой стороной не
+// выводятся. Отрезки идут по возрастанию позиций.
+std::vector<DiffSegment> GetPatienceSegments(const TokenId* from_tokens, uint32_t from_size,
+                                             const TokenId* to_tokens, uint32_t to_size);
+
+// Histogram diff, как в git: окно делится по общему отрезку с наименьшим
+// числом вхождений его токенов в from. Если все общие токены встречаются
+// в диапазоне чаще max_chain_length раз, диапазон отдается Майерсу.
+std::vector<DiffSegment> GetHistogramSegments(const TokenId* from_tokens, uint32_t from_size,
+                                              const TokenId* to_tokens, uint32_t to_size,
+                                              uint32_t max_chain_length);
+
+// Деление окна на независимые куски для параллельного расчета: по уникальным
+// общим токенам, как в patience diff, но только на верхнем уровне и только
+// там, где с прошлого разреза набралось не меньше min_chunk_size токенов.
+// Куски выводятся диапазонами для Майерса, токены разрезов - змейками.
+std::vector<DiffSegment> GetUniqueAnchorChunks(const TokenId* from_tokens, uint32_t from_size,
+                                               const TokenId* to_tokens, uint32_t to_size,
+                                               uint32_t min_chunk_size);
@@ -0,0 +1,201 @@
+#include "BitParallelLcs.h"
+#include "TokenMatch.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t kWordBits = 64;
+
+// Диапазоны с меньшей суммарной длиной дешевле досчитать Майерсом
+constexpr uint32_t kLeafSize = 64;
+
+uint32_t WordsCount(uint32_t bits_count) {
+    return (bits_count + kWordBits - 1) / kWordBits;
+}
+
+// Строки LCS для префиксов pattern по всему text. Токены заранее сжаты
+// в плотные номера, чтобы таблица совпадений была массивом
+class LcsRowSweep {
+public:
+    LcsRowSweep(uint32_t alphabet_size, uint32_t max_pattern_size)
+        : match_(static_cast<size_t>(alphabet_size) * WordsCount(max_pattern_size)) {
+    }
+
+    // lengths[i] = LCS(pattern[0, i), text) для всех i от 0 до pattern_size
+    void Sweep(const uint32_t* pattern, uint32_t pattern_size,
+               const uint32_t* text, uint32_t text_size, std::vector<uint32_t>& lengths) {
+        uint32_t words = WordsCount(pattern_size);
+        for (uint32_t id = 0; id < pattern_size; ++id) {
+            match_[static_cast<size_t>(pattern[id]) * words + id / kWordBits] |= 1ull << (id % kWordBits);
+        }
+        
+        // Нулевой бит i означает, что LCS растет на токене pattern[i]
+        row_.assign(words, ~0ull);
+        for (uint32_t text_id = 0; text_id < text_size; ++text_id) {
+            const uint64_t* match = match_.data() + static_cast<size_t>(text[text_id]) * words;
+            uint64_t carry = 0;
+            for (uint32_t word = 0; word < words; ++word) {
+                uint64_t row = row_[word];
+                uint64_t matched = row & match[word];
+                uint64_t sum = row + matched;
+                uint64_t next_carry = sum < row;
+                sum += carry;
+                next_carry |= sum < carry;
+                carry = next_carry;
+                row_[word] = sum | (row & ~match[word]);
+            }
+        }
+        
+        lengths.resize(pattern_size + 1);
+        lengths[0] = 0;
+        for (uint32_t id = 0; id < pattern_size; ++id) {
+            lengths[id + 1] = lengths[id] + !((row_[id / kWordBits] >> (id % kWordBits)) & 1);
+        }
+        
+        // Таблица остается нулевой для следующего прохода
+        for (uint32_t id = 0; id < pattern_size; ++id) {
+            match_[static_cast<size_t>(pattern[id]) * words + id / kWordBits] = 0;
+        }
+    }
+
+private:
+    std::vector<uint64_t> match_;
+    std::vector<uint64_t> row_;
+};
+
+// Плотные номера токенов обоих текстов; false, если токенов больше max_alphabet
+bool CompactAlphabet(const TokenId* from_tokens, uint32_t from_size,
+                     const TokenId* to_tokens, uint32_t to_size, uint32_t max_alphabet,
+                     std::vector<uint32_t>& from_symbols, std::vector<uint32_t>& to_symbols,
+                     uint32_t& alphabet_size) {
+    std::unordered_map<TokenId, uint32_t> symbols;
+    auto compact = [&](const TokenId* tokens, uint32_t size, std::vector<uint32_t>& result) {
+        result.resize(size);
+        for (uint32_t id = 0; id < size; ++id) {
+            auto [it, inserted] = symbols.emplace(tokens[id], symbols.size());
+            if (inserted && symbols.size() > max_alphabet) {
+                return false;
+            }
+            result[id] = it->second;
+        }
+        return true;
+    };
+    
+    if (!compact(from_tokens, from_size, from_symbols) || !compact(to_tokens, to_size, to_symbols)) {
+        return false;
+    }
+    alphabet_size = symbols.size();
+    return true;
+}
+
+}  // namespace
+
+std::optional<uint32_t> GetBitParallelLcsLength(const TokenId* from_tokens, uint32_t from_size,
+                                                const TokenId* to_tokens, uint32_t to_size,
+                                                uint32_t max_alphabet) {
+    std::vector<uint32_t> from_symbols;
+    std::vector<uint32_t> to_symbols;
+    uint32_t alphabet_size = 0;
+    if (!CompactAlphabet(from_tokens, from_size, to_tokens, to_size, max_alphabet,
+                         from_symbols, to_symbols, alphabet_size)) {
+        return std::nullopt;
+    }
+    
+    std::vector<uint32_t> lengths;
+    LcsRowSweep(alphabet_size, from_size).Sweep(from_symbols.data(), from_size,
+                                                to_symbols.data(), to_size, lengths);
+    return lengths.back();
+}
+
+std::optional<std::vector<DiffSegment>> GetBitParallelSegments(const TokenId* from_tokens, uint32_t from_size,
+                                                               const TokenId* to_tokens, uint32_t to_size,
+                                                               uint32_t max_alphabet) {
+    std::vector<uint32_t> from_symbols;
+    std::vector<uint32_t> to_symbols;
+    uint32_t alphabet_size = 0;
+    if (!CompactAlphabet(from_tokens, from_size, to_tokens, to_size, max_alphabet,
+                         from_symbols, to_symbols, alphabet_size)) {
+        return std::nullopt;
+    }
+    
+    // Обратный проход - прямой проход по развернутым последовательностям
+    std::vector<uint32_t> reversed_from(from_symbols.rbegin(), from_symbols.rend());
+    std::vector<uint32_t> reversed_to(to_symbols.rbegin(), to_symbols.rend());
+    
+    LcsRowSweep sweep(alphabet_size, from_size);
+    std::vector<uint32_t> direct_lengths;
+    std::vector<uint32_t> reversed_lengths;
+    std::vector<DiffSegment> segments;
+    
+    // Стек обходится с конца, поэтому правая половина кладется первой
+    std::vector<DiffSegment> tasks{{0, from_size, 0, to_size, false}};
+    while (!tasks.empty()) {
+        DiffSegment task = tasks.back();
+        tasks.pop_back();
+        
+        if (task.is_snake) {
+            segments.push_back(task);
+            continue;
+        }
+        
+        uint32_t common_size = std::min(task.from_right - task.from_left, task.to_right - task.to_left);
+        uint32_t prefix = CommonPrefixLength(from_tokens + task.from_left, to_tokens + task.to_left,
+                                             common_size);
+        uint32_t suffix = CommonSuffixLength(from_tokens + task.from_right, to_tokens + task.to_right,
+                                             common_size - prefix);
+        if (prefix > 0) {
+            segments.push_back({task.from_left, task.from_left + prefix,
+                                task.to_left, task.to_left + prefix, true});
+        }
+        if (suffix > 0) {
+            tasks.push_back({task.from_right - suffix, task.from_right,
+                             task.to_right - suffix, task.to_right, true});
+        }
+        
+        uint32_t from_left = task.from_left + prefix;
+        uint32_t from_right = task.from_right - suffix;
+        uint32_t to_left = task.to_left + prefix;
+        uint32_t to_right = task.to_right - suffix;
+        uint32_t middle_from_size = from_right - from_left;
+        uint32_t middle_to_size = to_right - to_left;
+        if (middle_from_size == 0 || middle_to_size == 0) {
+            continue;
+        }
+        
+        if (middle_to_size == 1) {
+            auto it = std::find(from_tokens + from_left, from_tokens + from_right, to_tokens[to_left]);
+            if (it != from_tokens + from_right) {
+                uint32_t from_id = it - from_tokens;
+                segments.push_back({from_id, from_id + 1, to_left, to_right, true});
+            }
+            continue;
+        }
+        
+        if (middle_from_size + middle_to_size <= kLeafSize) {
+            segments.push_back({from_left, from_right, to_left, to_right, false});
+            continue;
+        }
+        
+        uint32_t to_middle = to_left + middle_to_size / 2;
+        sweep.Sweep(from_symbols.data() + from_left, middle_from_size,
+                    to_symbols.data() + to_left, to_middle - to_left, direct_lengths);
+        sweep.Sweep(reversed_from.data() + (from_size - from_right), middle_from_size,
+                    reversed_to.data() + (to_size - to_right), to_right - to_middle, reversed_lengths);
+        
+        uint32_t best_split = 0;
+        uint32_t best_length = 0;
+        for (uint32_t split = 0; split <= middle_from_size; ++split) {
+            uint32_t length = direct_lengths[split] + reversed_lengths[middle_from_size - split];
+            if (length > best_length) {
+                best_length = length;
+                best_split = split;
+            }
+        }
+        
+        tasks.push_back({from_left + best_split, from_right, to_middle, to_right, false});
+        tasks.push_back({from_left, from_left + best_split, to_left, to_middle, false});
+    }
+    
+    return segments;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "AnchorDiff.h"
+#include <optional>
+
+// Длина LCS бит-параллельным алгоритмом Хиррё (Allison-Dix): строка
+// динамики по from хранится битами в 64-битных словах и обновляется
+// несколькими словарными операциями на каждый токен to.
+// nullopt, если в текстах больше max_alphabet различных токенов.
+std::optional<uint32_t> GetBitParallelLcsLength(const TokenId* from_tokens, uint32_t from_size,
+                                                const TokenId* to_tokens, uint32_t to_size,
+                                                uint32_t max_alphabet);
+
+// Деление окна по Хиршбергу: to режется пополам, а точка разреза from на
+// оптимальном пути находится по строкам LCS прямого и обратного проходов.
+// Мелкие диапазоны отдаются Майерсу, поэтому скрипт остается минимальным.
+// nullopt, если в окне больше max_alphabet различных токенов.
+std::optional<std::vector<DiffSegment>> GetBitParallelSegments(const TokenId* from_tokens, uint32_t from_size,
+                                                               const TokenId* to_tokens, uint32_t to_size,
+                                                               uint32_t max_alphabet);
@@ -1,9 +1,219 @@
 #include "MyersDiff.h"
+#include "TokenMatch.h"
+#include "ThreadPool.h"
+#include "AnchorDiff.h"
+#include "BitParallelLcs.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <array>
 #include <unordered_map>
 #include <cmath>
+#include <cstring>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+// Запас токенов между отрезанными байтами и окном токенизации: контекст
+// вывода в пределах запаса не требует токенизировать отрезанные части
+constexpr uint32_t kSkipMarginTokens = 32;
+
+// Таблица совпадений бит-параллельного прохода занимает по строке на токен
+constexpr uint32_t kBitParallelMaxAlphabet = 256;
+
+// Начальная емкость стека декомпозиции; при большей глубине стек растет в куче
+constexpr size_t kInitialDecompositionStack = 256;
+
+// Начальный запас шагов поиска средней змейки; дальше память удваивается
+constexpr uint32_t kInitialScriptSize = 64;
+
+// Подзадачи, таблица LCS которых помещается в столько клеток, решаются
+// динамикой на стеке без поиска средней змейки
+constexpr uint32_t kBaseCaseCells = 256;
+
+// Более короткие окна не окупают перекодирования токенов в плотные номера
+constexpr uint32_t kDenseRemapMinTokens = 1024;
+
+// Таблица по номеру токена не больше этого числа элементов строится всегда,
+// большая - только если окно длиннее ее четверти
+constexpr TokenId kDenseTableMinSize = 1 << 16;
+constexpr uint32_t kDenseTableTokensRatio = 4;
+
+// Номера разных токенов окна, от 0 в порядке первого появления. Словари
+// выдают номера подряд, и таблица перекодировки - плотный массив по номеру
+// токена. Но словарь из файла может содержать сколь угодно большие номера:
+// тогда массив был бы много больше окна, и таблица хранится в хеше.
+class DenseTokenIds {
+public:
+    DenseTokenIds(const TokenId* from_tokens, uint32_t from_size,
+                  const TokenId* to_tokens, uint32_t to_size) {
+        TokenId max_token = 0;
+        for (uint32_t id = 0; id < from_size; ++id) {
+            max_token = std::max(max_token, from_tokens[id]);
+        }
+        for (uint32_t id = 0; id < to_size; ++id) {
+            max_token = std::max(max_token, to_tokens[id]);
+        }
+        
+        is_sparse_ = max_token >= kDenseTableMinSize &&
+                     max_token / kDenseTableTokensRatio >= uint64_t{from_size} + to_size;
+        if (!is_sparse_) {
+            dense_ids_.assign(static_cast<size_t>(max_token) + 1, UINT32_MAX);
+        }
+        Add(from_tokens, from_size);
+        Add(to_tokens, to_size);
+    }
+    
+    uint32_t Get(TokenId token) const {
+        return is_sparse_ ? sparse_ids_.find(token)->second : dense_ids_[token];
+    }
+    
+    uint32_t Size() const {
+        return size_;
+    }
+    
+private:
+    void Add(const TokenId* tokens, uint32_t size) {
+        for (uint32_t id = 0; id < size; ++id) {
+            if (is_sparse_) {
+                if (sparse_ids_.emplace(tokens[id], size_).second) {
+                    ++size_;
+                }
+            } else if (dense_ids_[tokens[id]] == UINT32_MAX) {
+                dense_ids_[tokens[id]] = size_++;
+            }
+        }
+    }
+    
+    bool is_sparse_ = false;
+    std::vector<uint32_t> dense_ids_;
+    std::unordered_map<TokenId, uint32_t> sparse_ids_;
+    uint32_t size_ = 0;
+};
+
+// Рабочая память расчета: внешняя, если она свободна, иначе своя
+class WorkspaceLease {
+public:
+    explicit WorkspaceLease(MyersWorkspace* shared)
+        : shared_(shared && shared->TryAcquire() ? shared : nullptr) {}
+    
+    ~WorkspaceLease() {
+        if (shared_) {
+            shared_->Release();
+        }
+    }
+    
+    WorkspaceLease(const WorkspaceLease&) = delete;
+    WorkspaceLease& operator=(const WorkspaceLease&) = delete;
+    
+    MyersWorkspace& Get() {
+        return shared_ ? *shared_ : local_;
+    }
+    
+private:
+    MyersWorkspace* shared_;
+    MyersWorkspace local_;
+};
+
+template <typename Symbol>
+std::vector<Symbol> RemapTokens(const TokenId* tokens, uint32_t size, const DenseTokenIds& dense_ids) {
+    std::vector<Symbol> symbols(size);
+    for (uint32_t id = 0; id < size; ++id) {
+        symbols[id] = static_cast<Symbol>(dense_ids.Get(tokens[id]));
+    }
+    return symbols;
+}
+
+// Восстанавливает замены по картам совпадений. Декомпозиция размечает окно
+// слева направо, поэтому замены можно выдавать по ходу: замена готова, когда
+// за ней в размеченной части стоит совпавшая пара. Змейка, разрезанная
+// границей, замены не порождает, так что скрипт не зависит от частоты вызовов.
+class ScriptEmitter {
+public:
+    ScriptEmitter(const MatchBitmap& from_matched, const MatchBitmap& to_matched,
+                  uint32_t shift, const ReplacementSink& sink)
+        : from_matched_(from_matched), to_matched_(to_matched), shift_(shift), sink_(sink) {}
+
+    // Окно левее from_resolved и to_resolved размечено окончательно
+    void Advance(uint32_t from_resolved, uint32_t to_resolved) {
+        while (true) {
+            // Отрезок до from_checked_ уже просмотрен и отметок не содержит:
+            // размеченная часть не меняется, и повторно ее не сканируем
+            from_checked_ = from_matched_.FindMatched(std::max(from_id_, from_checked_), from_resolved);
+            to_checked_ = to_matched_.FindMatched(std::max(to_id_, to_checked_), to_resolved);
+            if (from_checked_ == from_resolved || to_checked_ == to_resolved) {
+                return;
+            }
+            
+            uint32_t from_match = from_checked_;
+            uint32_t to_match = to_checked_;
+            if (from_match != from_id_ || to_match != to_id_) {
+                sink_(Replacement{shift_ + from_id_, shift_ + from_match, shift_ + to_id_, shift_ + to_match});
+            }
+            
+            // Общий участок кончается на первом пропуске любой из сторон
+            uint32_t length = std::min(from_matched_.FindUnmatched(from_match, from_resolved) - from_match,
+                                       to_matched_.FindUnmatched(to_match, to_resolved) - to_match);
+            from_id_ = from_match + length;
+            to_id_ = to_match + length;
+        }
+    }
+    
+    // Отмеченных токенов в обеих картах поровну, поэтому после последней
+    // пары остается не больше одной замены - до концов окна
+    void Finish() {
+        uint32_t from_size = from_matched_.Size();
+        uint32_t to_size = to_matched_.Size();
+        Advance(from_size, to_size);
+        if (from_id_ != from_size || to_id_ != to_size) {
+            sink_(Replacement{shift_ + from_id_, shift_ + from_size, shift_ + to_id_, shift_ + to_size});
+        }
+    }
+
+private:
+    const MatchBitmap& from_matched_;
+    const MatchBitmap& to_matched_;
+    uint32_t shift_;
+    const ReplacementSink& sink_;
+    uint32_t from_id_ = 0;
+    uint32_t to_id_ = 0;
+    uint32_t from_checked_ = 0;
+    uint32_t to_checked_ = 0;
+};
+
+size_t CommonBytePrefixLength(const char* text1, const char* text2, size_t limit) {
+    constexpr size_t kBlockSize = 64;
+    size_t length = 0;
+    
+    while (length + kBlockSize <= limit && std::memcmp(text1 + length, text2 + length, kBlockSize) == 0) {
+        length += kBlockSize;
+    }
+    
+    while (length < limit && text1[length] == text2[length]) {
+        ++length;
+    }
+    
+    return length;
+}
+
+size_t CommonByteSuffixLength(const char* end1, const char* end2, size_t limit) {
+    constexpr size_t kBlockSize = 64;
+    size_t length = 0;
+    
+    while (length + kBlockSize <= limit &&
+           std::memcmp(end1 - length - kBlockSize, end2 - length - kBlockSize, kBlockSize) == 0) {
+        length += kBlockSize;
+    }
+    
+    while (length < limit && *(end1 - length - 1) == *(end2 - length - 1)) {
+        ++length;
+    }
+    
+    return length;
+}
+
+}  // namespace
 
 Snake::Snake(uint32_t begin_x, uint32_t begin_y, uint32_t width)
     : begin_x_(begin_x), begin_y_(begin_y), width_(width) {
@@ -21,252 +231,1212 @@ std::pair<uint32_t, uint32_t> Snake::End() const {
     return {begin_x_ + width_, begin_y_ + width_};
 }
 
+bool MyersWorkspace::TryAcquire() {
+    return !busy_.exchange(true, std::memory_order_acquire);
+}
+
+void MyersWorkspace::Release() {
+    busy_.store(false, std::memory_order_release);
+}
+
+void MyersWorkspace::Reserve(uint32_t diagonals_count) {
+    if (max_direct_path_.size() < diagonals_count) {
+        max_direct_path_.resize(diagonals_count);
+        max_reversed_path_.resize(diagonals_count);
+    }
+}
+
+uint32_t* MyersWorkspace::DirectPath() {
+    return max_direct_path_.data();
+}
+
+int32_t* MyersWorkspace::ReversedPath() {
+    return max_reversed_path_.data();
+}
+
+void MyersWorkspace::Shift(uint32_t diagonals_count, uint32_t shift) {
+    Reserve(diagonals_count + 2 * shift);
+    std::copy_backward(max_direct_path_.begin(), max_direct_path_.begin() + diagonals_count,
+                       max_direct_path_.begin() + diagonals_count + shift);
+    std::copy_backward(max_reversed_path_.begin(), max_reversed_path_.begin() + diagonals_count,
+                       max_reversed_path_.begin() + diagonals_count + shift);
+}
+
+MatchBitmap::MatchBitmap(uint32_t size) : words_((static_cast<size_t>(size) + 63) / 64), size_(size) {}
+
+void MatchBitmap::MarkRange(uint32_t begin, uint32_t end) {
+    if (begin >= end) {
+        return;
+    }
+    
+    size_t first_word = begin / 64;
+    size_t last_word = (end - 1) / 64;
+    uint64_t first_mask = ~uint64_t{0} << (begin % 64);
+    uint64_t last_mask = ~uint64_t{0} >> (63 - (end - 1) % 64);
+    
+    if (first_word == last_word) {
+        __atomic_fetch_or(&words_[first_word], first_mask & last_mask, __ATOMIC_RELAXED);
+        return;
+    }
+    
+    // Слова целиком внутри отрезка не делятся ни с какой другой задачей
+    __atomic_fetch_or(&words_[first_word], first_mask, __ATOMIC_RELAXED);
+    for (size_t word = first_word + 1; word < last_word; ++word) {
+        words_[word] = ~uint64_t{0};
+    }
+    __atomic_fetch_or(&words_[last_word], last_mask, __ATOMIC_RELAXED);
+}
+
+void MatchBitmap::Mark(uint32_t id) {
+    words_[id / 64] |= uint64_t{1} << (id % 64);
+}
+
+uint32_t MatchBitmap::FindMatched(uint32_t id, uint32_t end) const {
+    return Find(id, end, 0);
+}
+
+uint32_t MatchBitmap::FindUnmatched(uint32_t id, uint32_t end) const {
+    return Find(id, end, ~uint64_t{0});
+}
+
+uint32_t MatchBitmap::Find(uint32_t id, uint32_t end, uint64_t invert) const {
+    // Пропускаем по слову за раз: длинные змейки и правки проходятся за N / 64
+    while (id < end) {
+        uint64_t word = (words_[id / 64] ^ invert) & (~uint64_t{0} << (id % 64));
+        if (word != 0) {
+            return std::min<uint32_t>(id / 64 * 64 + __builtin_ctzll(word), end);
+        }
+        id = (id / 64 + 1) * 64;
+    }
+    return end;
+}
+
+uint32_t MatchBitmap::Size() const {
+    return size_;
+}
+
 MyersDiff::MyersDiff(std::unique_ptr<UniversalTokenizer> tokenizer, 
                      const std::string& text1, 
-                     const std::string& text2)
-    : tokenizer_(std::move(tokenizer)) {
+                     const std::string& text2,
+                     const MyersDiffOptions& options)
+    : tokenizer_(std::move(tokenizer)), options_(options) {
+    
+    // Чаще всего тексты совпадают целиком: сравнение байтов дешевле любой
+    // токенизации, а скрипт для них пуст. Текст хранится как отрезанное
+    // начало, его токены понадобятся только для LCS. Число токенов не
+    // считается: размеры нужны лишь форматам непустого скрипта.
+    if (text1.size() == text2.size() && std::memcmp(text1.data(), text2.data(), text1.size()) == 0) {
+        skipped_prefix_ = text1;
+        return;
+    }
+    
+    // Отрезанные байты должны быть дешевле в подсчете, чем в токенизации:
+    // BPE считает токены тем же Encode, и пропуск только удвоил бы работу
+    size_t prefix_bytes = 0;
+    size_t suffix_bytes = 0;
+    if (options_.skip_common_bytes && tokenizer_->HasFastTokenCount()) {
+        SkipCommonBytes(text1, text2, prefix_bytes, suffix_bytes);
+    }
+    
+    if (prefix_bytes == 0 && suffix_bytes == 0) {
+        from_tokens_ = tokenizer_->Encode(text1);
+        to_tokens_ = tokenizer_->Encode(text2);
+        return;
+    }
+    
+    skipped_prefix_ = text1.substr(0, prefix_bytes);
+    skipped_suffix_ = text1.substr(text1.size() - suffix_bytes);
+    skipped_prefix_size_ = tokenizer_->CountTokens(skipped_prefix_);
+    skipped_suffix_size_ = tokenizer_->CountTokens(skipped_suffix_);
     
-    from_tokens_ = tokenizer_->Encode(text1);
-    to_tokens_ = tokenizer_->Encode(text2);
+    from_tokens_ = tokenizer_->Encode(text1.substr(prefix_bytes, text1.size() - prefix_bytes - suffix_bytes));
+    to_tokens_ = tokenizer_->Encode(text2.substr(prefix_bytes, text2.size() - prefix_bytes - suffix_bytes));
 }
 
-std::pair<uint32_t, Snake> MyersDiff::GetMiddleSnake(uint32_t from_left, uint32_t from_right, 
+void MyersDiff::SkipCommonBytes(const std::string& text1, const std::string& text2,
+                                size_t& prefix_bytes, size_t& suffix_bytes) const {
+    // Отступаем от первого несовпадения к границе токена, пройдя еще
+    // kSkipMarginTokens границ: между соседними границами есть хотя бы один токен
+    auto back_off = [](size_t length, auto is_boundary) {
+        uint32_t boundaries = 0;
+        while (length > 0) {
+            if (is_boundary(length) && boundaries++ == kSkipMarginTokens) {
+                break;
+            }
+            --length;
+        }
+        return length;
+    };
+    
+    size_t limit = std::min(text1.size(), text2.size());
+    prefix_bytes = CommonBytePrefixLength(text1.data(), text2.data(), limit);
+    prefix_bytes = back_off(prefix_bytes, [&](size_t pos) {
+        return tokenizer_->IsTokenBoundary(text1, pos) && tokenizer_->IsTokenBoundary(text2, pos);
+    });
+    
+    suffix_bytes = CommonByteSuffixLength(text1.data() + text1.size(), text2.data() + text2.size(),
+                                          limit - prefix_bytes);
+    suffix_bytes = back_off(suffix_bytes, [&](size_t length) {
+        return tokenizer_->IsTokenBoundary(text1, text1.size() - length) &&
+               tokenizer_->IsTokenBoundary(text2, text2.size() - length);
+    });
+}
+
+uint32_t MyersDiff::FromSize() const {
+    return skipped_prefix_size_ + from_tokens_.size() + skipped_suffix_size_;
+}
+
+uint32_t MyersDiff::ToSize() const {
+    return skipped_prefix_size_ + to_tokens_.size() + skipped_suffix_size_;
+}
+
+TokenId MyersDiff::GetToken(const std::vector<TokenId>& window, uint32_t id) const {
+    if (id >= skipped_prefix_size_ && id - skipped_prefix_size_ < window.size()) {
+        return window[id - skipped_prefix_size_];
+    }
+    
+    LoadSkippedTokens();
+    if (id < skipped_prefix_size_) {
+        return skipped_prefix_tokens_[id];
+    }
+    return skipped_suffix_tokens_[id - skipped_prefix_size_ - window.size()];
+}
+
+std::string MyersDiff::DecodeToken(TokenId token) const {
+    std::lock_guard<std::mutex> lock(tokenizer_mutex_);
+    return tokenizer_->Decode({token});
+}
+
+void MyersDiff::LoadSkippedTokens() const {
+    std::call_once(skipped_once_, [this] {
+        std::lock_guard<std::mutex> lock(tokenizer_mutex_);
+        skipped_prefix_tokens_ = tokenizer_->Encode(skipped_prefix_);
+        skipped_suffix_tokens_ = tokenizer_->Encode(skipped_suffix_);
+    });
+}
+
+// Состояние поиска средней змейки в прямоугольнике
+// [from_left, from_right) x [to_left, to_right)
+struct MyersDiff::MiddleSnakeState {
+    uint32_t from_left;
+    uint32_t from_right;
+    uint32_t to_left;
+    uint32_t to_right;
+    int32_t delta;
+    uint32_t offset;
+    // Шаги до max_script_size помещаются в diagonals_count диагоналей памяти
+    uint32_t max_script_size;
+    uint32_t diagonals_count;
+    uint32_t* max_direct_path;
+    int32_t* max_reversed_path;
+};
+
+void MyersDiff::ReserveDiagonals(MyersWorkspace& workspace, MiddleSnakeState& state,
+                                 uint32_t script_size) const {
+    if (script_size <= state.max_script_size) {
+        return;
+    }
+    
+    // Запас удваивается. Все диагонали сдвигаются на одну величину, а
+    // хранятся в них позиции внутри окна, так что значения не меняются.
+    uint32_t shift = std::max(script_size, state.max_script_size * 2) - state.max_script_size;
+    workspace.Shift(state.diagonals_count, shift);
+    state.max_script_size += shift;
+    state.offset += shift;
+    state.diagonals_count += 2 * shift;
+    state.max_direct_path = workspace.DirectPath();
+    state.max_reversed_path = workspace.ReversedPath();
+}
+
+template <typename Symbol>
+std::pair<uint32_t, Snake> MyersDiff::GetMiddleSnake(const SnakeSearch<Symbol>& search,
+                                                  uint32_t from_left, uint32_t from_right, 
                                                   uint32_t to_left, uint32_t to_right) const {
     uint32_t from_size = from_right - from_left;
     uint32_t to_size = to_right - to_left;
 
     uint32_t total_size = from_size + to_size;
     int32_t delta = from_size - to_size;
-    uint32_t offset = total_size + 1 + std::abs(delta);
     bool is_odd = total_size & 1;
 
-    std::vector<uint32_t> max_direct_path(offset * 2);
-    std::vector<int32_t> max_reversed_path(offset * 2, from_size + 1);
+    // Шаг script_size затрагивает диагонали не дальше script_size от
+    // стартовых, так что память заводится под первые шаги и растет вместе
+    // с D: при небольшой правке в большом окне не трогаем O(N + M) памяти.
+    uint32_t max_script_size = std::min((total_size + 1) / 2, kInitialScriptSize);
+    uint32_t offset = max_script_size + 1 + (delta < 0 ? -delta : 0);
+    uint32_t diagonals_count = offset + (delta > 0 ? delta : 0) + max_script_size + 2;
+
+    // Каждая диагональ шага script_size читает только соседей с предыдущего
+    // шага, поэтому старое содержимое рабочей памяти не мешает: достаточно
+    // задать две стартовые точки, из которых выходят первые проходы.
+    search.workspace.Reserve(diagonals_count);
+    MiddleSnakeState state{from_left, from_right, to_left, to_right, delta, offset,
+                           max_script_size, diagonals_count,
+                           search.workspace.DirectPath(), search.workspace.ReversedPath()};
+    state.max_direct_path[offset + 1] = 0;
+    state.max_reversed_path[offset + delta + 1] = from_size + 1;
+
+    if (options_.concurrent_sweeps && total_size >= options_.concurrent_sweeps_cutoff) {
+        return GetMiddleSnakeConcurrently(search, state);
+    }
 
     for (uint32_t script_size = 0; script_size <= (total_size + 1) / 2; ++script_size) {
-        uint32_t lowest_diag = offset - script_size;
-        uint32_t highest_diag = offset + script_size;
+        ReserveDiagonals(search.workspace, state, script_size);
+        if (auto snake = ForwardStep(search, state, script_size, is_odd)) {
+            return {script_size * 2 - 1, *snake};
+        }
+        if (auto snake = ReverseStep(search, state, script_size, !is_odd)) {
+            return {script_size * 2, *snake};
+        }
         
-        // Прямой проход
-        for (uint32_t diagonal = lowest_diag; diagonal <= highest_diag; diagonal += 2) {
-            uint32_t from_id;
-            if (diagonal == lowest_diag ||
-                (diagonal != highest_diag &&
-                 max_direct_path[diagonal - 1] < max_direct_path[diagonal + 1])) {
-                from_id = max_direct_path[diagonal + 1];
-            } else {
-                from_id = max_direct_path[diagonal - 1] + 1;
+        if (search.max_cost && script_size >= search.max_cost) {
+            if (auto split = GetExpensiveSplit(state, script_size)) {
+                return {script_size * 2, *split};
             }
+        }
+    }
+    
+    throw std::logic_error("SES не найден");
+}
 
-            uint32_t to_id = from_id + offset - diagonal + to_left;
-            from_id += from_left;
-            uint32_t snake_length = 0;
-            
-            // Расширяем змейку пока есть совпадения
-            while (from_id < from_right && to_id < to_right && 
-                   from_tokens_[from_id] == to_tokens_[to_id]) {
-                ++from_id;
-                ++to_id;
-                ++snake_length;
-            }
-            
-            max_direct_path[diagonal] = from_id - from_left;
-
-            // Проверяем, нашли ли мы среднюю змейку
-            if (is_odd && diagonal >= lowest_diag + delta + 1 &&
-                diagonal <= highest_diag + delta - 1 &&
-                static_cast<int32_t>(max_direct_path[diagonal]) >= max_reversed_path[diagonal]) {
-                return {script_size * 2 - 1,
-                        {from_id - snake_length, to_id - snake_length, snake_length}};
+template <typename Symbol>
+std::pair<uint32_t, Snake> MyersDiff::GetMiddleSnakeConcurrently(const SnakeSearch<Symbol>& search,
+                                                              MiddleSnakeState& state) const {
+    // Прямой проход идет в текущем потоке, обратный - во вспомогательном.
+    // На шаге D прямой проход пишет диагонали четности D, а читает (при
+    // нечетной сумме длин) обратные с шага D - 1, которые обратный проход
+    // сейчас не трогает, так что проходы синхронизируются только между шагами.
+    // Встречу при четной сумме ищем после шага, когда оба массива готовы.
+    uint32_t total_size = (state.from_right - state.from_left) + (state.to_right - state.to_left);
+    bool is_odd = total_size & 1;
+    uint32_t last_step = (total_size + 1) / 2;
+    if (options_.stats) {
+        options_.stats->concurrent_sweeps.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    std::atomic<uint32_t> started_steps{0};
+    std::atomic<uint32_t> finished_steps{0};
+    std::atomic<bool> stop{false};
+    
+    auto spin_until = [](auto condition) {
+        for (uint32_t spins = 0; !condition(); ++spins) {
+            if (spins % 64 == 63) {
+                std::this_thread::yield();
             }
         }
-
-        // Обратный проход
-        lowest_diag += delta;
-        highest_diag += delta;
-        for (uint32_t diagonal = lowest_diag; diagonal <= highest_diag; diagonal += 2) {
-            int32_t from_id;
-            if (diagonal == lowest_diag ||
-                (diagonal != highest_diag &&
-                 max_reversed_path[diagonal + 1] <= max_reversed_path[diagonal - 1])) {
-                from_id = max_reversed_path[diagonal + 1] - 1;
-            } else {
-                from_id = max_reversed_path[diagonal - 1];
+    };
+    
+    std::thread reverse_sweep([&] {
+        for (uint32_t script_size = 0; script_size <= last_step; ++script_size) {
+            spin_until([&] {
+                return stop.load(std::memory_order_acquire) ||
+                       started_steps.load(std::memory_order_acquire) > script_size;
+            });
+            if (stop.load(std::memory_order_acquire)) {
+                return;
             }
-
-            int32_t to_id = from_id + offset - diagonal + to_left;
-            from_id += from_left;
-            uint32_t snake_length = 0;
             
-            // Расширяем змейку в обратном направлении
-            while (from_id > static_cast<int32_t>(from_left) &&
-                   to_id > static_cast<int32_t>(to_left) && 
-                   from_tokens_[from_id - 1] == to_tokens_[to_id - 1]) {
-                --from_id;
-                --to_id;
-                ++snake_length;
+            ReverseStep(search, state, script_size, false);
+            finished_steps.store(script_size + 1, std::memory_order_release);
+        }
+    });
+    
+    auto finish = [&](uint32_t ses_size, const Snake& snake) {
+        stop.store(true, std::memory_order_release);
+        reverse_sweep.join();
+        return std::make_pair(ses_size, snake);
+    };
+    
+    for (uint32_t script_size = 0; script_size <= last_step; ++script_size) {
+        // Обратный проход начинает шаг, только когда закончена проверка
+        // встречи предыдущего: она читает его соседние диагонали. До этого
+        // он не трогает и память, так что расширять ее можно здесь.
+        ReserveDiagonals(search.workspace, state, script_size);
+        started_steps.store(script_size + 1, std::memory_order_release);
+        auto forward_snake = ForwardStep(search, state, script_size, is_odd);
+        spin_until([&] { return finished_steps.load(std::memory_order_acquire) > script_size; });
+        
+        if (forward_snake) {
+            return finish(script_size * 2 - 1, *forward_snake);
+        }
+        
+        if (!is_odd) {
+            uint32_t lowest_diag = state.offset + state.delta - script_size;
+            uint32_t highest_diag = state.offset + state.delta + script_size;
+            for (uint32_t diagonal = lowest_diag; diagonal <= highest_diag; diagonal += 2) {
+                if (auto snake = ReverseOverlap(state, script_size, diagonal)) {
+                    return finish(script_size * 2, *snake);
+                }
             }
-            
-            max_reversed_path[diagonal] = from_id - from_left;
-
-            // Проверяем, нашли ли мы среднюю змейку
-            if (!is_odd && diagonal >= lowest_diag - delta && diagonal <= highest_diag - delta &&
-                static_cast<int32_t>(max_direct_path[diagonal]) >= max_reversed_path[diagonal]) {
-                return {
-                    script_size * 2,
-                    {static_cast<uint32_t>(from_id), static_cast<uint32_t>(to_id), snake_length}};
+        }
+        
+        if (search.max_cost && script_size >= search.max_cost) {
+            if (auto split = GetExpensiveSplit(state, script_size)) {
+                return finish(script_size * 2, *split);
             }
         }
     }
     
+    stop.store(true, std::memory_order_release);
+    reverse_sweep.join();
     throw std::logic_error("SES не найден");
 }
 
-void MyersDiff::GetSnakeDecomposition(uint32_t from_left, uint32_t from_right, 
-                                     uint32_t to_left, uint32_t to_right,
-                                     std::vector<int32_t>& from_snake,
-                                     std::vector<int32_t>& to_snake, 
-                                     uint32_t& current_snake) const {
-    auto [ses_size, snake] = GetMiddleSnake(from_left, from_right, to_left, to_right);
-    
-    if (ses_size > 1) {
-        auto [from_begin, to_begin] = snake.Begin();
-        auto [from_end, to_end] = snake.End();
+template <typename Symbol>
+std::optional<Snake> MyersDiff::ForwardStep(const SnakeSearch<Symbol>& search, MiddleSnakeState& state,
+                                            uint32_t script_size, bool check_overlap) const {
+    uint32_t* max_direct_path = state.max_direct_path;
+    const int32_t* max_reversed_path = state.max_reversed_path;
+    uint32_t from_left = state.from_left;
+    uint32_t from_right = state.from_right;
+    uint32_t to_left = state.to_left;
+    uint32_t to_right = state.to_right;
+    uint32_t offset = state.offset;
+    int32_t delta = state.delta;
+    
+    uint32_t lowest_diag = offset - script_size;
+    uint32_t highest_diag = offset + script_size;
+    
+    // Прямой проход
+    for (uint32_t diagonal = lowest_diag; diagonal <= highest_diag; diagonal += 2) {
+        uint32_t from_id;
+        if (diagonal == lowest_diag ||
+            (diagonal != highest_diag &&
+             max_direct_path[diagonal - 1] < max_direct_path[diagonal + 1])) {
+            from_id = max_direct_path[diagonal + 1];
+        } else {
+            from_id = max_direct_path[diagonal - 1] + 1;
+        }
+
+        uint32_t to_id = from_id + offset - diagonal + to_left;
+        from_id += from_left;
+        uint32_t snake_length = 0;
         
-        // Обрабатываем левую часть
-        GetSnakeDecomposition(from_left, from_begin, to_left, to_begin, from_snake,
-                             to_snake, current_snake);
+        // Расширяем змейку пока есть совпадения. Первый токен сравниваем
+        // сразу: большинство змеек короткие, и вызов векторного ядра
+        // окупается только на длинных совпадениях
+        if (from_id < from_right && to_id < to_right &&
+            search.from_tokens[from_id] == search.to_tokens[to_id]) {
+            snake_length = CommonPrefixLength(search.from_tokens + from_id,
+                                              search.to_tokens + to_id,
+                                              std::min(from_right - from_id, to_right - to_id));
+            from_id += snake_length;
+            to_id += snake_length;
+        }
         
-        // Отмечаем змейку
-        for (uint32_t id = 0; id < snake.Width(); ++id) {
-            from_snake[from_begin + id] = to_snake[to_begin + id] = current_snake;
+        max_direct_path[diagonal] = from_id - from_left;
+
+        // Проверяем, нашли ли мы среднюю змейку
+        if (check_overlap && diagonal >= lowest_diag + delta + 1 &&
+            diagonal <= highest_diag + delta - 1 &&
+            static_cast<int32_t>(max_direct_path[diagonal]) >= max_reversed_path[diagonal]) {
+            return Snake(from_id - snake_length, to_id - snake_length, snake_length);
         }
+    }
+    
+    return std::nullopt;
+}
+
+template <typename Symbol>
+std::optional<Snake> MyersDiff::ReverseStep(const SnakeSearch<Symbol>& search, MiddleSnakeState& state,
+                                            uint32_t script_size, bool check_overlap) const {
+    const uint32_t* max_direct_path = state.max_direct_path;
+    int32_t* max_reversed_path = state.max_reversed_path;
+    uint32_t from_left = state.from_left;
+    uint32_t to_left = state.to_left;
+    uint32_t offset = state.offset;
+    int32_t delta = state.delta;
+    
+    uint32_t lowest_diag = offset + delta - script_size;
+    uint32_t highest_diag = offset + delta + script_size;
+    
+    // Обратный проход
+    for (uint32_t diagonal = lowest_diag; diagonal <= highest_diag; diagonal += 2) {
+        int32_t from_id = ReverseStart(state, script_size, diagonal);
+        int32_t to_id = from_id + offset - diagonal + to_left;
+        from_id += from_left;
+        uint32_t snake_length = 0;
         
-        if (snake.Width() > 0) {
-            ++current_snake;
+        // Расширяем змейку в обратном направлении
+        if (from_id > static_cast<int32_t>(from_left) &&
+            to_id > static_cast<int32_t>(to_left) && 
+            search.from_tokens[from_id - 1] == search.to_tokens[to_id - 1]) {
+            snake_length = CommonSuffixLength(search.from_tokens + from_id,
+                                              search.to_tokens + to_id,
+                                              std::min(from_id - from_left, to_id - to_left));
+            from_id -= snake_length;
+            to_id -= snake_length;
         }
         
-        // Обрабатываем правую часть
-        GetSnakeDecomposition(from_end, from_right, to_end, to_right, from_snake,
-                             to_snake, current_snake);
-    } else if (from_right - from_left < to_right - to_left) {
+        max_reversed_path[diagonal] = from_id - from_left;
 
-        if (from_right == from_left) {
-            return;
+        // Проверяем, нашли ли мы среднюю змейку
+        if (check_overlap && diagonal >= lowest_diag - delta && diagonal <= highest_diag - delta &&
+            static_cast<int32_t>(max_direct_path[diagonal]) >= max_reversed_path[diagonal]) {
+            return Snake(static_cast<uint32_t>(from_id), static_cast<uint32_t>(to_id), snake_length);
         }
+    }
+    
+    return std::nullopt;
+}
+
+int32_t MyersDiff::ReverseStart(const MiddleSnakeState& state, uint32_t script_size,
+                                uint32_t diagonal) const {
+    const int32_t* max_reversed_path = state.max_reversed_path;
+    uint32_t lowest_diag = state.offset + state.delta - script_size;
+    uint32_t highest_diag = state.offset + state.delta + script_size;
+    
+    if (diagonal == lowest_diag ||
+        (diagonal != highest_diag &&
+         max_reversed_path[diagonal + 1] <= max_reversed_path[diagonal - 1])) {
+        return max_reversed_path[diagonal + 1] - 1;
+    }
+    return max_reversed_path[diagonal - 1];
+}
+
+std::optional<Snake> MyersDiff::ReverseOverlap(const MiddleSnakeState& state, uint32_t script_size,
+                                               uint32_t diagonal) const {
+    // При четной сумме длин обратная диагональ совпадает с прямой того же шага
+    if (diagonal < state.offset - script_size || diagonal > state.offset + script_size ||
+        static_cast<int32_t>(state.max_direct_path[diagonal]) < state.max_reversed_path[diagonal]) {
+        return std::nullopt;
+    }
+    
+    // Начало змейки восстанавливается по соседним диагоналям прошлого шага,
+    // которые еще не перезаписаны
+    uint32_t snake_length = ReverseStart(state, script_size, diagonal) - state.max_reversed_path[diagonal];
+    uint32_t from_id = state.max_reversed_path[diagonal] + state.from_left;
+    uint32_t to_id = state.max_reversed_path[diagonal] + state.offset - diagonal + state.to_left;
+    return Snake(from_id, to_id, snake_length);
+}
+
+std::optional<Snake> MyersDiff::GetExpensiveSplit(const MiddleSnakeState& state,
+                                                  uint32_t script_size) const {
+    // Поиск стал слишком дорогим: как в GNU diff, делим задачу в точке,
+    // дальше всего продвинувшейся от своего угла, пустой змейкой
+    int64_t from_size = state.from_right - state.from_left;
+    int64_t to_size = state.to_right - state.to_left;
+    auto inside = [&](int64_t from_id, int64_t to_id) {
+        return from_id >= 0 && from_id <= from_size && to_id >= 0 && to_id <= to_size;
+    };
+    
+    int64_t best_forward = -1;
+    int64_t forward_from = 0;
+    for (uint32_t diagonal = state.offset - script_size; diagonal <= state.offset + script_size;
+         diagonal += 2) {
+        int64_t from_id = state.max_direct_path[diagonal];
+        int64_t to_id = from_id + state.offset - diagonal;
+        if (inside(from_id, to_id) && from_id + to_id > best_forward) {
+            best_forward = from_id + to_id;
+            forward_from = from_id;
+        }
+    }
+    
+    int64_t best_reverse = from_size + to_size + 1;
+    int64_t reverse_from = 0;
+    for (uint32_t diagonal = state.offset + state.delta - script_size;
+         diagonal <= state.offset + state.delta + script_size; diagonal += 2) {
+        int64_t from_id = state.max_reversed_path[diagonal];
+        int64_t to_id = from_id + state.offset - diagonal;
+        if (inside(from_id, to_id) && from_id + to_id < best_reverse) {
+            best_reverse = from_id + to_id;
+            reverse_from = from_id;
+        }
+    }
+    
+    bool use_forward = best_forward >= from_size + to_size - best_reverse;
+    int64_t from_id = use_forward ? forward_from : reverse_from;
+    int64_t to_id = (use_forward ? best_forward : best_reverse) - from_id;
+    
+    // Деление в углу не уменьшает задачу
+    if (from_id + to_id <= 0 || from_id + to_id >= from_size + to_size) {
+        return std::nullopt;
+    }
+    
+    return Snake(state.from_left + from_id, state.to_left + to_id, 0);
+}
+
+template <typename Symbol>
+bool MyersDiff::PreferBitParallel(const SnakeSearch<Symbol>& search, uint32_t from_size, uint32_t to_size) const {
+    uint32_t total_size = from_size + to_size;
+    if (options_.algorithm != DiffAlgorithm::MYERS || total_size < options_.bit_parallel_cutoff ||
+        !dynamic_cast<const CharacterTokenizer*>(tokenizer_.get())) {
+        return false;
+    }
+    
+    // Бит-параллельный расчет стоит порядка N * M / 32 операций, Майерс на
+    // практике - порядка N + M + D^2. Пробный поиск средней змейки ограничен
+    // половиной равновесного D: если змейка за это время не нашлась, Майерс дороже.
+    double balance = std::sqrt(static_cast<double>(from_size) * to_size / 32);
+    uint32_t probe_cost = std::max<uint32_t>(balance / 2, 1);
+    SnakeSearch<Symbol> probe{search.from_tokens, search.to_tokens, search.workspace, probe_cost, nullptr};
+    return GetMiddleSnake(probe, 0, from_size, 0, to_size).first >= 2 * probe_cost;
+}
+
+uint32_t MyersDiff::GetMaxCost(uint32_t total_size) const {
+    if (options_.minimal) {
+        return 0;
+    }
+    if (options_.max_cost) {
+        return options_.max_cost;
+    }
+    if (!options_.heuristic) {
+        return 0;
+    }
+    
+    // Как в GNU diff: примерно корень из числа диагоналей, но не меньше 4096
+    uint32_t max_cost = 1;
+    for (uint64_t diagonals = total_size + 3; diagonals != 0; diagonals >>= 2) {
+        max_cost <<= 1;
+    }
+    return std::max(max_cost, 4096u);
+}
+
+template <typename Symbol>
+void MyersDiff::GetSnakeDecomposition(const SnakeSearch<Symbol>& search,
+                                     uint32_t from_left, uint32_t from_right, 
+                                     uint32_t to_left, uint32_t to_right,
+                                     MatchBitmap& from_matched,
+                                     MatchBitmap& to_matched, 
+                                     TaskGroup* group) const {
+    // Рекурсия заменена явным стеком: глубина декомпозиции достигает O(D),
+    // и на длинных чередующихся правках стек потока переполнялся.
+    // Змейки отмечаются в битовых картах сторон: части, решенные в разных
+    // потоках, занимают непересекающиеся отрезки.
+    struct Task {
+        uint32_t from_left;
+        uint32_t from_right;
+        uint32_t to_left;
+        uint32_t to_right;
+        bool is_snake;  // Отметить змейку шириной from_right - from_left
+    };
+    
+    std::vector<Task> tasks;
+    tasks.reserve(kInitialDecompositionStack);
+    tasks.push_back({from_left, from_right, to_left, to_right, false});
+    
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
         
-        int32_t shift = 0;
-        for (uint32_t id = 0; id < from_right - from_left; ++id) {
-            if (from_tokens_[from_left + id] != to_tokens_[to_left + id + shift]) {
-                ++current_snake;
-                ++shift;
+        if (task.is_snake) {
+            uint32_t to_end = task.to_left + (task.from_right - task.from_left);
+            from_matched.MarkRange(task.from_left, task.from_right);
+            to_matched.MarkRange(task.to_left, to_end);
+            // Левая часть из стека уже снята, так что все до конца змейки размечено
+            if (search.resolved) {
+                (*search.resolved)(task.from_right, to_end);
             }
-            from_snake[from_left + id] = to_snake[to_left + id + shift] = current_snake;
+            continue;
         }
-        ++current_snake;
-    } else {
-
-        if (to_right == to_left) {
-            return;
+        
+        uint64_t cells = uint64_t{task.from_right - task.from_left + 1} * (task.to_right - task.to_left + 1);
+        if (cells <= kBaseCaseCells) {
+            MarkSmallSubproblem(search, task.from_left, task.from_right, task.to_left, task.to_right,
+                                from_matched, to_matched);
+            if (search.resolved) {
+                (*search.resolved)(task.from_right, task.to_right);
+            }
+            continue;
         }
         
-        int32_t shift = 0;
-        for (uint32_t id = 0; id < to_right - to_left; ++id) {
-            if (id + shift < from_right - from_left && 
-                from_tokens_[from_left + id + shift] != to_tokens_[to_left + id]) {
-                ++current_snake;
-                ++shift;
+        auto [ses_size, snake] = GetMiddleSnake(search, task.from_left, task.from_right,
+                                                task.to_left, task.to_right);
+        
+        if (ses_size > 1) {
+            auto [from_begin, to_begin] = snake.Begin();
+            auto [from_end, to_end] = snake.End();
+            
+            // Крупная правая часть независима от левой и уходит в пул
+            // со своей рабочей памятью, мелкая остается в стеке
+            uint32_t right_size = (task.from_right - from_end) + (task.to_right - to_end);
+            if (group && right_size >= options_.parallel_cutoff) {
+                ForkSnakeDecomposition(search, from_end, task.from_right, to_end, task.to_right,
+                                       from_matched, to_matched, *group);
+            } else {
+                tasks.push_back({from_end, task.from_right, to_end, task.to_right, false});
             }
-            if (id + shift < from_right - from_left) {
-                from_snake[from_left + id + shift] = to_snake[to_left + id] = current_snake;
+            
+            tasks.push_back({from_begin, from_end, to_begin, to_end, true});
+            tasks.push_back({task.from_left, from_begin, task.to_left, to_begin, false});
+        } else {
+            MarkShortSnakes(search, task.from_left, task.from_right, task.to_left, task.to_right,
+                            from_matched, to_matched);
+            if (search.resolved) {
+                (*search.resolved)(task.from_right, task.to_right);
             }
         }
-        ++current_snake;
     }
 }
 
-std::vector<TokenId> MyersDiff::GetLargestCommonSubsequence() const {
-    if (from_tokens_.empty() || to_tokens_.empty()) {
-        return {};
+template <typename Symbol>
+void MyersDiff::ForkSnakeDecomposition(const SnakeSearch<Symbol>& search,
+                                      uint32_t from_left, uint32_t from_right,
+                                      uint32_t to_left, uint32_t to_right,
+                                      MatchBitmap& from_matched,
+                                      MatchBitmap& to_matched,
+                                      TaskGroup& group) const {
+    // Задача в пуле работает со своей рабочей памятью потока
+    const Symbol* from_tokens = search.from_tokens;
+    const Symbol* to_tokens = search.to_tokens;
+    uint32_t max_cost = search.max_cost;
+    if (options_.stats) {
+        options_.stats->forked_tasks.fetch_add(1, std::memory_order_relaxed);
+    }
+    group.Run([=, &from_matched, &to_matched, &group] {
+        thread_local MyersWorkspace thread_workspace;
+        SnakeSearch<Symbol> thread_search{from_tokens, to_tokens, thread_workspace, max_cost, nullptr};
+        GetSnakeDecomposition(thread_search, from_left, from_right, to_left, to_right,
+                              from_matched, to_matched, &group);
+    });
+}
+
+template <typename Symbol>
+void MyersDiff::MarkShortSnakes(const SnakeSearch<Symbol>& search,
+                                uint32_t from_left, uint32_t from_right, 
+                                uint32_t to_left, uint32_t to_right,
+                                MatchBitmap& from_matched,
+                                MatchBitmap& to_matched) const {
+    // Не больше одной правки: совпадает все, кроме одного лишнего токена
+    // более длинной стороны, стоящего сразу за общим префиксом
+    uint32_t from_size = from_right - from_left;
+    uint32_t to_size = to_right - to_left;
+    uint32_t prefix = CommonPrefixLength(search.from_tokens + from_left, search.to_tokens + to_left,
+                                         std::min(from_size, to_size));
+    
+    if (from_size < to_size) {
+        from_matched.MarkRange(from_left, from_right);
+        to_matched.MarkRange(to_left, to_left + prefix);
+        to_matched.MarkRange(to_left + prefix + 1, to_right);
+    } else {
+        to_matched.MarkRange(to_left, to_right);
+        from_matched.MarkRange(from_left, from_left + prefix);
+        from_matched.MarkRange(from_left + prefix + 1, from_right);
+    }
+}
+
+template <typename Symbol>
+bool MyersDiff::MarkGreedyPath(const SnakeSearch<Symbol>& search, uint32_t from_size, uint32_t to_size,
+                               MatchBitmap& from_matched, MatchBitmap& to_matched) const {
+    // Фронт шага script_size - самые дальние точки диагоналей k = from_id - to_id
+    // с k = -script_size, -script_size + 2, ..., script_size: script_size + 1
+    // значений, строки всех шагов подряд. По ним обратный ход восстанавливает
+    // и выбор хода, и начало каждой змейки. Одних битов хода мало: без фронта
+    // прошлого шага неизвестно, где змейка началась.
+    size_t max_entries = options_.greedy_trace_bytes / sizeof(uint32_t);
+    if (max_entries == 0) {
+        return false;
     }
     
-    std::vector<int32_t> from_snake(from_tokens_.size(), -1);
-    std::vector<int32_t> to_snake(to_tokens_.size(), -1);
-    uint32_t current_snake = 0;
+    // Один проход выигрывает, пока D заметно меньше sqrt(N + M): дальше запись
+    // фронтов обходится дороже, чем повторное сканирование змеек рекурсией.
+    // Предел стоимости поиска средней змейки относится к половине пути.
+    uint32_t max_steps = std::sqrt(static_cast<double>(from_size) + to_size) / 2;
+    if (search.max_cost) {
+        max_steps = std::min(max_steps, 2 * search.max_cost);
+    }
     
-    GetSnakeDecomposition(0, from_tokens_.size(), 0, to_tokens_.size(), 
-                         from_snake, to_snake, current_snake);
+    const Symbol* from_tokens = search.from_tokens;
+    const Symbol* to_tokens = search.to_tokens;
+    int64_t final_diagonal = static_cast<int64_t>(from_size) - to_size;
+    std::vector<uint32_t> trace;
+    auto row_start = [](uint32_t script_size) {
+        return static_cast<size_t>(script_size) * (script_size + 1) / 2;
+    };
+    auto at = [&](uint32_t script_size, int64_t diagonal) -> uint32_t& {
+        return trace[row_start(script_size) + (diagonal + script_size) / 2];
+    };
+    auto from_down = [&](uint32_t script_size, int64_t diagonal) {
+        return diagonal == -static_cast<int64_t>(script_size) ||
+               (diagonal != script_size && at(script_size - 1, diagonal - 1) < at(script_size - 1, diagonal + 1));
+    };
     
-    std::vector<TokenId> lcs;
-    for (uint32_t i = 0; i < from_tokens_.size(); ++i) {
-        if (from_snake[i] != -1) {
-            lcs.push_back(from_tokens_[i]);
+    uint32_t script_size = 0;
+    for (;; ++script_size) {
+        if (script_size > max_steps || row_start(script_size + 1) > max_entries) {
+            return false;
+        }
+        trace.resize(row_start(script_size + 1));
+        
+        bool found = false;
+        for (int64_t diagonal = -static_cast<int64_t>(script_size); diagonal <= script_size; diagonal += 2) {
+            uint32_t from_id = 0;
+            if (script_size > 0) {
+                from_id = from_down(script_size, diagonal) ? at(script_size - 1, diagonal + 1)
+                                                           : at(script_size - 1, diagonal - 1) + 1;
+            }
+            int64_t to_id = from_id - diagonal;
+            if (from_id < from_size && to_id >= 0 && to_id < to_size &&
+                from_tokens[from_id] == to_tokens[to_id]) {
+                from_id += CommonPrefixLength(from_tokens + from_id, to_tokens + to_id,
+                                              std::min<int64_t>(from_size - from_id, to_size - to_id));
+            }
+            at(script_size, diagonal) = from_id;
+            found |= diagonal == final_diagonal && from_id >= from_size;
+        }
+        if (found) {
+            break;
         }
     }
     
-    return lcs;
+    // Обратный ход от (from_size, to_size): змейка шага кончается в точке
+    // фронта и начинается там, куда привел ход с прошлого фронта
+    int64_t diagonal = final_diagonal;
+    uint32_t from_id = from_size;
+    for (; script_size > 0; --script_size) {
+        bool down = from_down(script_size, diagonal);
+        int64_t previous_diagonal = down ? diagonal + 1 : diagonal - 1;
+        uint32_t previous_from = at(script_size - 1, previous_diagonal);
+        uint32_t snake_begin = down ? previous_from : previous_from + 1;
+        from_matched.MarkRange(snake_begin, from_id);
+        to_matched.MarkRange(snake_begin - diagonal, from_id - diagonal);
+        diagonal = previous_diagonal;
+        from_id = previous_from;
+    }
+    from_matched.MarkRange(0, from_id);
+    to_matched.MarkRange(0, from_id);
+    return true;
 }
 
-EditScript MyersDiff::GetShortestEditScript() const {
-    if (from_tokens_.empty()) {
-        if (!to_tokens_.empty()) {
-            return {Replacement{0, 0, 0, static_cast<uint32_t>(to_tokens_.size())}};
-        }
-        return {};
+template <typename Symbol>
+bool MyersDiff::MarkUnbalancedPath(const SnakeSearch<Symbol>& search, uint32_t from_size, uint32_t to_size,
+                                   MatchBitmap& from_matched, MatchBitmap& to_matched) const {
+    // Алгоритм O(NP) Ву, Манбера и Майерса. Короткая сторона a длины m, длинная
+    // b длины n, диагональ k = y - x, где x и y - позиции в a и b. Любой скрипт
+    // тратит на разность длин delta = n - m вставок, а остальные правки идут
+    // парами, так что D = delta + 2P, где P - число удалений из a. Раунд p
+    // обходит только диагонали [-p, delta + p], и при большой delta это
+    // намного дешевле O((N + M) D) поиска средней змейки, который перебирает
+    // все диагонали в пределах D от углов.
+    bool from_is_short = from_size <= to_size;
+    uint32_t short_size = from_is_short ? from_size : to_size;
+    uint32_t long_size = from_is_short ? to_size : from_size;
+    int64_t delta = long_size - short_size;
+    if (options_.greedy_trace_bytes == 0 || delta <= short_size) {
+        return false;
     }
     
-    if (to_tokens_.empty()) {
-        return {Replacement{0, static_cast<uint32_t>(from_tokens_.size()), 0, 0}};
+    const Symbol* a = from_is_short ? search.from_tokens : search.to_tokens;
+    const Symbol* b = from_is_short ? search.to_tokens : search.from_tokens;
+    MatchBitmap& a_matched = from_is_short ? from_matched : to_matched;
+    MatchBitmap& b_matched = from_is_short ? to_matched : from_matched;
+    
+    // Строка раунда p - самые дальние y на диагоналях [-p, delta + p]. Вне
+    // посчитанного ответ -1: из этой точки выходит путь из угла (0, 0).
+    size_t max_entries = options_.greedy_trace_bytes / sizeof(int32_t);
+    std::vector<int32_t> trace;
+    auto row_start = [&](int64_t round) {
+        return static_cast<size_t>(round * (delta + 1) + round * (round - 1));
+    };
+    auto value = [&](int64_t round, int64_t diagonal) -> int32_t {
+        if (round < 0 || diagonal < -round || diagonal > delta + round) {
+            return -1;
+        }
+        return trace[row_start(round) + diagonal + round];
+    };
+    // Раунд p считает диагонали ниже delta по возрастанию, выше - по убыванию,
+    // а delta последней, поэтому сосед берется из текущего раунда, если он
+    // посчитан раньше, и из прошлого иначе
+    auto right_round = [&](int64_t round, int64_t diagonal) { return diagonal <= delta ? round : round - 1; };
+    auto down_round = [&](int64_t round, int64_t diagonal) { return diagonal >= delta ? round : round - 1; };
+    auto snake_start = [&](int64_t round, int64_t diagonal, bool& from_left) {
+        int64_t right = value(right_round(round, diagonal), diagonal - 1) + 1;
+        int64_t down = value(down_round(round, diagonal), diagonal + 1);
+        // При равенстве ведет вниз: слева от диагонали -p стоит фиктивная -1,
+        // и настоящий путь там только сверху
+        from_left = right > down || down < 0;
+        return std::max(right, down);
+    };
+    auto slide = [&](int64_t diagonal, int64_t y) {
+        int64_t x = y - diagonal;
+        if (x < short_size && y < long_size && a[x] == b[y]) {
+            y += CommonPrefixLength(a + x, b + y, std::min<int64_t>(short_size - x, long_size - y));
+        }
+        return y;
+    };
+    
+    int64_t round = 0;
+    for (;; ++round) {
+        if (row_start(round + 1) > max_entries || (search.max_cost && round > search.max_cost)) {
+            return false;
+        }
+        trace.resize(row_start(round + 1));
+        int32_t* row = trace.data() + row_start(round) + round;
+        bool from_left;
+        
+        for (int64_t diagonal = -round; diagonal < delta; ++diagonal) {
+            row[diagonal] = slide(diagonal, snake_start(round, diagonal, from_left));
+        }
+        for (int64_t diagonal = delta + round; diagonal > delta; --diagonal) {
+            row[diagonal] = slide(diagonal, snake_start(round, diagonal, from_left));
+        }
+        row[delta] = slide(delta, snake_start(round, delta, from_left));
+        if (row[delta] >= static_cast<int64_t>(long_size)) {
+            break;
+        }
     }
     
-    std::vector<int32_t> from_snake(from_tokens_.size(), -1);
-    std::vector<int32_t> to_snake(to_tokens_.size(), -1);
-    uint32_t current_snake = 0;
+    // Обратный ход от угла (m, n): змейка начинается там, куда привел ход
+    // с соседней диагонали, а соседняя точка берется из того же раунда,
+    // из которого ее читал прямой проход
+    int64_t diagonal = delta;
+    int64_t y = long_size;
+    while (true) {
+        bool from_left;
+        int64_t begin = snake_start(round, diagonal, from_left);
+        a_matched.MarkRange(begin - diagonal, y - diagonal);
+        b_matched.MarkRange(begin, y);
+        if (round == 0 && diagonal == 0) {
+            break;
+        }
+        
+        if (from_left) {
+            round = right_round(round, diagonal);
+            --diagonal;
+        } else {
+            round = down_round(round, diagonal);
+            ++diagonal;
+        }
+        y = value(round, diagonal);
+    }
+    return true;
+}
+
+template <typename Symbol>
+void MyersDiff::MarkSmallSubproblem(const SnakeSearch<Symbol>& search,
+                                    uint32_t from_left, uint32_t from_right,
+                                    uint32_t to_left, uint32_t to_right,
+                                    MatchBitmap& from_matched,
+                                    MatchBitmap& to_matched) const {
+    // В глубине рекурсии окна в несколько токенов: таблица длин LCS суффиксов
+    // дешевле двух проходов поиска средней змейки
+    uint32_t from_size = from_right - from_left;
+    uint32_t to_size = to_right - to_left;
+    uint32_t width = to_size + 1;
+    const Symbol* from_tokens = search.from_tokens + from_left;
+    const Symbol* to_tokens = search.to_tokens + to_left;
     
-    GetSnakeDecomposition(0, from_tokens_.size(), 0, to_tokens_.size(), 
-                         from_snake, to_snake, current_snake);
+    std::array<uint16_t, kBaseCaseCells> lcs;
+    for (uint32_t to_id = 0; to_id <= to_size; ++to_id) {
+        lcs[from_size * width + to_id] = 0;
+    }
+    for (uint32_t from_id = from_size; from_id-- > 0;) {
+        lcs[from_id * width + to_size] = 0;
+        for (uint32_t to_id = to_size; to_id-- > 0;) {
+            uint16_t* cell = &lcs[from_id * width + to_id];
+            if (from_tokens[from_id] == to_tokens[to_id]) {
+                *cell = cell[width + 1] + 1;
+            } else {
+                *cell = std::max(cell[width], cell[1]);
+            }
+        }
+    }
     
-    EditScript script;
+    // Проход слева направо: совпадающие токены всегда можно взять в пару,
+    // иначе, как и Майерс, сначала удаляем из from
+    uint32_t from_id = 0;
     uint32_t to_id = 0;
-    
-    for (uint32_t from_id = 0; from_id < from_tokens_.size(); ++from_id, ++to_id) {
-        uint32_t from_left = from_id;
-        
-        while (from_id < from_tokens_.size() && from_snake[from_id] == -1) {
+    uint32_t run_length = 0;
+    while (from_id < from_size && to_id < to_size) {
+        if (from_tokens[from_id] == to_tokens[to_id]) {
             ++from_id;
+            ++to_id;
+            ++run_length;
+            continue;
         }
         
-        uint32_t to_left = to_id;
-        
-        while (to_id < to_tokens_.size() &&
-               (from_id == from_tokens_.size() || to_snake[to_id] != from_snake[from_id])) {
+        from_matched.MarkRange(from_left + from_id - run_length, from_left + from_id);
+        to_matched.MarkRange(to_left + to_id - run_length, to_left + to_id);
+        run_length = 0;
+        if (lcs[(from_id + 1) * width + to_id] >= lcs[from_id * width + to_id + 1]) {
+            ++from_id;
+        } else {
             ++to_id;
         }
-        
-        if (from_left != from_id || to_left != to_id) {
-            script.emplace_back(Replacement{from_left, from_id, to_left, to_id});
+    }
+    from_matched.MarkRange(from_left + from_id - run_length, from_left + from_id);
+    to_matched.MarkRange(to_left + to_id - run_length, to_left + to_id);
+}
+
+void MyersDiff::DecomposeWindow(const TokenId* from_tokens, const TokenId* to_tokens,
+                                MatchBitmap& from_matched,
+                                MatchBitmap& to_matched,
+                                const ResolvedCallback* resolved) const {
+    uint32_t from_size = from_matched.Size();
+    uint32_t to_size = to_matched.Size();
+    if (from_size + to_size < kDenseRemapMinTokens) {
+        DecomposeSymbols(from_tokens, to_tokens, from_tokens, to_tokens, from_matched, to_matched, resolved);
+        return;
+    }
+    
+    // В окне редко бывает больше 65536 разных токенов, а посимвольно - обычно
+    // меньше 256. В плотных номерах по 1-2 байта горячие циклы сравнения
+    // читают в 2-4 раза меньше памяти.
+    DenseTokenIds dense_ids(from_tokens, from_size, to_tokens, to_size);
+    uint32_t alphabet_size = dense_ids.Size();
+    
+    if (alphabet_size <= UINT8_MAX + 1) {
+        auto from_symbols = RemapTokens<uint8_t>(from_tokens, from_size, dense_ids);
+        auto to_symbols = RemapTokens<uint8_t>(to_tokens, to_size, dense_ids);
+        DecomposeSymbols(from_tokens, to_tokens, from_symbols.data(), to_symbols.data(),
+                         from_matched, to_matched, resolved);
+    } else if (alphabet_size <= UINT16_MAX + 1) {
+        auto from_symbols = RemapTokens<uint16_t>(from_tokens, from_size, dense_ids);
+        auto to_symbols = RemapTokens<uint16_t>(to_tokens, to_size, dense_ids);
+        DecomposeSymbols(from_tokens, to_tokens, from_symbols.data(), to_symbols.data(),
+                         from_matched, to_matched, resolved);
+    } else {
+        DecomposeSymbols(from_tokens, to_tokens, from_tokens, to_tokens, from_matched, to_matched, resolved);
+    }
+}
+
+template <typename Symbol>
+void MyersDiff::DecomposeSymbols(const TokenId* from_tokens, const TokenId* to_tokens,
+                                 const Symbol* from_symbols, const Symbol* to_symbols,
+                                 MatchBitmap& from_matched,
+                                 MatchBitmap& to_matched,
+                                 const ResolvedCallback* resolved) const {
+    uint32_t from_size = from_matched.Size();
+    uint32_t to_size = to_matched.Size();
+    uint32_t total_size = from_size + to_size;
+
+    // Поиск средней змейки сам наращивает память по мере роста D
+    WorkspaceLease lease(options_.workspace);
+    MyersWorkspace& workspace = lease.Get();
+
+    SnakeSearch<Symbol> search{from_symbols, to_symbols, workspace, GetMaxCost(total_size), nullptr};
+    
+    std::vector<DiffSegment> segments;
+    switch (options_.algorithm) {
+        case DiffAlgorithm::PATIENCE:
+            segments = GetPatienceSegments(from_tokens, from_size, to_tokens, to_size);
+            break;
+        case DiffAlgorithm::HISTOGRAM:
+            segments = GetHistogramSegments(from_tokens, from_size, to_tokens, to_size,
+                                            options_.max_chain_length);
+            break;
+        default:
+            if (options_.chunk_by_anchors && options_.algorithm == DiffAlgorithm::MYERS &&
+                options_.thread_pool && total_size >= options_.parallel_cutoff) {
+                segments = GetUniqueAnchorChunks(from_tokens, from_size, to_tokens, to_size,
+                                                 options_.parallel_cutoff);
+                break;
+            }
+            if (options_.algorithm == DiffAlgorithm::MYERS &&
+                (MarkUnbalancedPath(search, from_size, to_size, from_matched, to_matched) ||
+                 MarkGreedyPath(search, from_size, to_size, from_matched, to_matched))) {
+                if (resolved) {
+                    (*resolved)(from_size, to_size);
+                }
+                return;
+            }
+            if (options_.algorithm == DiffAlgorithm::BIT_PARALLEL ||
+                PreferBitParallel(search, from_size, to_size)) {
+                if (auto bit_parallel = GetBitParallelSegments(from_tokens, from_size, to_tokens, to_size,
+                                                               kBitParallelMaxAlphabet)) {
+                    segments = std::move(*bit_parallel);
+                    break;
+                }
+            }
+            segments.push_back({0, from_size, 0, to_size, false});
+    }
+    
+    std::optional<TaskGroup> group;
+    if (options_.thread_pool && total_size >= options_.parallel_cutoff) {
+        group.emplace(*options_.thread_pool);
+    } else {
+        // Без пула части размечаются строго слева направо
+        search.resolved = resolved;
+    }
+    
+    for (const auto& segment : segments) {
+        if (segment.is_snake) {
+            from_matched.MarkRange(segment.from_left, segment.from_right);
+            to_matched.MarkRange(segment.to_left, segment.to_right);
+            if (search.resolved) {
+                (*search.resolved)(segment.from_right, segment.to_right);
+            }
+            continue;
         }
         
-        while (from_id + 1 < from_tokens_.size() && from_snake[from_id + 1] == from_snake[from_id]) {
-            ++from_id;
+        uint32_t segment_size = (segment.from_right - segment.from_left) + (segment.to_right - segment.to_left);
+        if (group && segments.size() > 1 && segment_size >= options_.parallel_cutoff) {
+            ForkSnakeDecomposition(search, segment.from_left, segment.from_right,
+                                   segment.to_left, segment.to_right, from_matched, to_matched, *group);
+        } else {
+            GetSnakeDecomposition(search, segment.from_left, segment.from_right,
+                                  segment.to_left, segment.to_right, from_matched, to_matched,
+                                  group ? &*group : nullptr);
         }
-        
-        while (to_id + 1 < to_tokens_.size() && to_snake[to_id + 1] == to_snake[to_id]) {
-            ++to_id;
+    }
+    
+    if (group) {
+        group->Wait();
+    }
+}
+
+void MyersDiff::DecomposeMatchable(const TokenId* from_tokens, const TokenId* to_tokens,
+                                   MatchBitmap& from_matched,
+                                   MatchBitmap& to_matched,
+                                   const ResolvedCallback* resolved) const {
+    uint32_t from_size = from_matched.Size();
+    uint32_t to_size = to_matched.Size();
+    
+    // Отметки сторон хранятся по плотным номерам токенов окна
+    DenseTokenIds dense_ids(from_tokens, from_size, to_tokens, to_size);
+    std::vector<uint8_t> sides(dense_ids.Size());
+    for (uint32_t id = 0; id < from_size; ++id) {
+        sides[dense_ids.Get(from_tokens[id])] |= 1;
+    }
+    for (uint32_t id = 0; id < to_size; ++id) {
+        sides[dense_ids.Get(to_tokens[id])] |= 2;
+    }
+    
+    std::vector<uint32_t> from_ids;
+    std::vector<uint32_t> to_ids;
+    for (uint32_t id = 0; id < from_size; ++id) {
+        if (sides[dense_ids.Get(from_tokens[id])] == 3) {
+            from_ids.push_back(id);
+        }
+    }
+    for (uint32_t id = 0; id < to_size; ++id) {
+        if (sides[dense_ids.Get(to_tokens[id])] == 3) {
+            to_ids.push_back(id);
         }
     }
     
-    if (to_id < to_tokens_.size()) {
-        script.emplace_back(Replacement{static_cast<uint32_t>(from_tokens_.size()),
-                                      static_cast<uint32_t>(from_tokens_.size()), to_id,
-                                      static_cast<uint32_t>(to_tokens_.size())});
+    if (from_ids.size() == from_size && to_ids.size() == to_size) {
+        DecomposeWindow(from_tokens, to_tokens, from_matched, to_matched, resolved);
+        return;
+    }
+    if (from_ids.empty()) {
+        return;
     }
     
+    std::vector<TokenId> compact_from(from_ids.size());
+    std::vector<TokenId> compact_to(to_ids.size());
+    for (size_t id = 0; id < from_ids.size(); ++id) {
+        compact_from[id] = from_tokens[from_ids[id]];
+    }
+    for (size_t id = 0; id < to_ids.size(); ++id) {
+        compact_to[id] = to_tokens[to_ids[id]];
+    }
+    
+    MatchBitmap compact_from_matched(compact_from.size());
+    MatchBitmap compact_to_matched(compact_to.size());
+    
+    // Отбрасывание не меняет порядка совпавших токенов, так что отметки
+    // переносятся на исходные позиции по отдельности для каждой стороны.
+    // При потоковой выдаче - по мере того, как размечается сжатое окно.
+    uint32_t from_mapped = 0;
+    uint32_t to_mapped = 0;
+    auto map_matches = [&](uint32_t from_resolved, uint32_t to_resolved) {
+        for (uint32_t id = compact_from_matched.FindMatched(from_mapped, from_resolved); id < from_resolved;
+             id = compact_from_matched.FindMatched(id + 1, from_resolved)) {
+            from_matched.Mark(from_ids[id]);
+        }
+        for (uint32_t id = compact_to_matched.FindMatched(to_mapped, to_resolved); id < to_resolved;
+             id = compact_to_matched.FindMatched(id + 1, to_resolved)) {
+            to_matched.Mark(to_ids[id]);
+        }
+        from_mapped = from_resolved;
+        to_mapped = to_resolved;
+    };
+    
+    // Отброшенные токены перед первым неразмеченным тоже размечены: как пропуски
+    ResolvedCallback compact_resolved = [&](uint32_t from_resolved, uint32_t to_resolved) {
+        map_matches(from_resolved, to_resolved);
+        (*resolved)(from_resolved < from_ids.size() ? from_ids[from_resolved] : from_size,
+                    to_resolved < to_ids.size() ? to_ids[to_resolved] : to_size);
+    };
+    
+    DecomposeWindow(compact_from.data(), compact_to.data(), compact_from_matched, compact_to_matched,
+                    resolved ? &compact_resolved : nullptr);
+    map_matches(compact_from_matched.Size(), compact_to_matched.Size());
+}
+
+std::vector<TokenId> MyersDiff::GetLargestCommonSubsequence() const {
+    const EditScript& script = GetCachedEditScript();
+    LoadSkippedTokens();
+    
+    // Замены лежат внутри окна токенизации, отрезанные части совпадают целиком
+    std::vector<TokenId> lcs = skipped_prefix_tokens_;
+    uint32_t from_id = 0;
+    for (const auto& rep : script) {
+        lcs.insert(lcs.end(), from_tokens_.begin() + from_id,
+                   from_tokens_.begin() + (rep.from_left - skipped_prefix_size_));
+        from_id = rep.from_right - skipped_prefix_size_;
+    }
+    lcs.insert(lcs.end(), from_tokens_.begin() + from_id, from_tokens_.end());
+    lcs.insert(lcs.end(), skipped_suffix_tokens_.begin(), skipped_suffix_tokens_.end());
+    
+    return lcs;
+}
+
+EditScript MyersDiff::GetShortestEditScript() const {
+    return GetCachedEditScript();
+}
+
+const EditScript& MyersDiff::GetCachedEditScript() const {
+    std::call_once(script_once_, [this] { script_ = ComputeShortestEditScript(); });
+    return script_;
+}
+
+EditScript MyersDiff::ComputeShortestEditScript() const {
+    EditScript script;
+    EmitShortestEditScript([&script](const Replacement& replacement) { script.push_back(replacement); },
+                           false);
     return script;
 }
 
+void MyersDiff::StreamShortestEditScript(const ReplacementSink& sink) const {
+    EmitShortestEditScript(sink, true);
+}
+
+void MyersDiff::EmitShortestEditScript(const ReplacementSink& sink, bool streaming) const {
+    // Общие начало и конец не влияют на скрипт, поэтому алгоритм Майерса
+    // запускается только на окне между ними
+    uint32_t common_size = std::min(from_tokens_.size(), to_tokens_.size());
+    uint32_t prefix = CommonPrefixLength(from_tokens_.data(), to_tokens_.data(), common_size);
+    uint32_t suffix = CommonSuffixLength(from_tokens_.data() + from_tokens_.size(),
+                                         to_tokens_.data() + to_tokens_.size(),
+                                         common_size - prefix);
+    
+    uint32_t from_size = from_tokens_.size() - prefix - suffix;
+    uint32_t to_size = to_tokens_.size() - prefix - suffix;
+    uint32_t shift = skipped_prefix_size_ + prefix;
+    
+    if (from_size == 0) {
+        if (to_size != 0) {
+            sink(Replacement{shift, shift, shift, shift + to_size});
+        }
+        return;
+    }
+    
+    if (to_size == 0) {
+        sink(Replacement{shift, shift + from_size, shift, shift});
+        return;
+    }
+    
+    MatchBitmap from_matched(from_size);
+    MatchBitmap to_matched(to_size);
+    ScriptEmitter emitter(from_matched, to_matched, shift, sink);
+    ResolvedCallback resolved = [&emitter](uint32_t from_resolved, uint32_t to_resolved) {
+        emitter.Advance(from_resolved, to_resolved);
+    };
+    
+    if (options_.discard_unmatched) {
+        DecomposeMatchable(from_tokens_.data() + prefix, to_tokens_.data() + prefix, from_matched, to_matched,
+                           streaming ? &resolved : nullptr);
+    } else {
+        DecomposeWindow(from_tokens_.data() + prefix, to_tokens_.data() + prefix, from_matched, to_matched,
+                        streaming ? &resolved : nullptr);
+    }
+    emitter.Finish();
+}
+
 std::string MyersDiff::GetDiff(DiffFormat format, int context_size) const {
-    EditScript script = GetShortestEditScript();
+    const EditScript& script = GetCachedEditScript();
     
     switch (format) {
         case DiffFormat::UNIFIED:
@@ -288,40 +1458,48 @@ std::string MyersDiff::FormatUnifiedDiff(const EditScript& script, int context_s
     std::stringstream result;
     result << "--- a" << std::endl;
     result << "+++ b" << std::endl;
+    result << GetUnifiedHunks(script, context_size, 0, 0);
+    
+    return result.str();
+}
+
+std::string MyersDiff::GetUnifiedHunks(const EditScript& script, int context_size,
+                                       uint64_t from_offset, uint64_t to_offset) const {
+    std::stringstream result;
     
     for (const auto& rep : script) {
 
         uint32_t from_start = (rep.from_left > static_cast<uint32_t>(context_size)) ? 
                              rep.from_left - context_size : 0;
         uint32_t from_end = std::min(rep.from_right + context_size, 
-                                    static_cast<uint32_t>(from_tokens_.size()));
+                                    FromSize());
         uint32_t to_start = (rep.to_left > static_cast<uint32_t>(context_size)) ? 
                            rep.to_left - context_size : 0;
         uint32_t to_end = std::min(rep.to_right + context_size, 
-                                  static_cast<uint32_t>(to_tokens_.size()));
+                                  ToSize());
         
         // Заголовок ханка
-        result << "@@ -" << (from_start + 1) << "," << (from_end - from_start) 
-               << " +" << (to_start + 1) << "," << (to_end - to_start) << " @@" << std::endl;
+        result << "@@ -" << (from_offset + from_start + 1) << "," << (from_end - from_start) 
+               << " +" << (to_offset + to_start + 1) << "," << (to_end - to_start) << " @@" << std::endl;
         
         // Выводим контекст до изменения
         for (uint32_t i = from_start; i < rep.from_left; ++i) {
-            result << " " << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+            result << " " << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
         }
         
         // Выводим удаления
         for (uint32_t i = rep.from_left; i < rep.from_right; ++i) {
-            result << "-" << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+            result << "-" << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
         }
         
         // Выводим добавления
         for (uint32_t i = rep.to_left; i < rep.to_right; ++i) {
-            result << "+" << tokenizer_->Decode({to_tokens_[i]}) << std::endl;
+            result << "+" << DecodeToken(GetToken(to_tokens_, i)) << std::endl;
         }
         
         // Выводим контекст после изменения
         for (uint32_t i = rep.from_right; i < from_end; ++i) {
-            result << " " << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+            result << " " << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
         }
     }
     
@@ -342,11 +1520,11 @@ std::string MyersDiff::FormatContextDiff(const EditScript& script, int context_s
         uint32_t from_start = (rep.from_left > static_cast<uint32_t>(context_size)) ? 
                              rep.from_left - context_size : 0;
         uint32_t from_end = std::min(rep.from_right + context_size, 
-                                    static_cast<uint32_t>(from_tokens_.size()));
+                                    FromSize());
         uint32_t to_start = (rep.to_left > static_cast<uint32_t>(context_size)) ? 
                            rep.to_left - context_size : 0;
         uint32_t to_end = std::min(rep.to_right + context_size, 
-                                  static_cast<uint32_t>(to_tokens_.size()));
+                                  ToSize());
         
         // Заголовок ханка для первого файла
         result << "***************" << std::endl;
@@ -356,9 +1534,9 @@ std::string MyersDiff::FormatContextDiff(const EditScript& script, int context_s
         // Выводим контекст и удаления для первого файла
         for (uint32_t i = from_start; i < from_end; ++i) {
             if (i >= rep.from_left && i < rep.from_right) {
-                result << "- " << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+                result << "- " << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
             } else {
-                result << "  " << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+                result << "  " << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
             }
         }
         
@@ -369,9 +1547,9 @@ std::string MyersDiff::FormatContextDiff(const EditScript& script, int context_s
         // Выводим контекст и добавления для второго файла
         for (uint32_t i = to_start; i < to_end; ++i) {
             if (i >= rep.to_left && i < rep.to_right) {
-                result << "+ " << tokenizer_->Decode({to_tokens_[i]}) << std::endl;
+                result << "+ " << DecodeToken(GetToken(to_tokens_, i)) << std::endl;
             } else {
-                result << "  " << tokenizer_->Decode({to_tokens_[i]}) << std::endl;
+                result << "  " << DecodeToken(GetToken(to_tokens_, i)) << std::endl;
             }
         }
     }
@@ -393,7 +1571,7 @@ std::string MyersDiff::FormatNormalDiff(const EditScript& script) const {
                    << "," << rep.to_right << std::endl;
             
             for (uint32_t i = rep.to_left; i < rep.to_right; ++i) {
-                result << "> " << tokenizer_->Decode({to_tokens_[i]}) << std::endl;
+                result << "> " << DecodeToken(GetToken(to_tokens_, i)) << std::endl;
             }
         } else if (rep.to_left == rep.to_right) {
             // Только удаления
@@ -401,7 +1579,7 @@ std::string MyersDiff::FormatNormalDiff(const EditScript& script) const {
                    << "d" << rep.to_left << std::endl;
             
             for (uint32_t i = rep.from_left; i < rep.from_right; ++i) {
-                result << "< " << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+                result << "< " << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
             }
         } else {
             // Изменения
@@ -409,13 +1587,13 @@ std::string MyersDiff::FormatNormalDiff(const EditScript& script) const {
                    << "c" << rep.to_left + 1 << "," << rep.to_right << std::endl;
             
             for (uint32_t i = rep.from_left; i < rep.from_right; ++i) {
-                result << "< " << tokenizer_->Decode({from_tokens_[i]}) << std::endl;
+                result << "< " << DecodeToken(GetToken(from_tokens_, i)) << std::endl;
             }
             
             result << "---" << std::endl;
             
             for (uint32_t i = rep.to_left; i < rep.to_right; ++i) {
-                result << "> " << tokenizer_->Decode({to_tokens_[i]}) << std::endl;
+                result << "> " << DecodeToken(GetToken(to_tokens_, i)) << std::endl;
             }
         }
     }
@@ -424,7 +1602,7 @@ std::string MyersDiff::FormatNormalDiff(const EditScript& script) const {
 }
 
 int MyersDiff::GetLevenshteinDistance() const {
-    EditScript script = GetShortestEditScript();
+    const EditScript& script = GetCachedEditScript();
     int distance = 0;
     
     for (const auto& rep : script) {
@@ -434,17 +1612,95 @@ int MyersDiff::GetLevenshteinDistance() const {
     return distance;
 }
 
-bool MyersDiff::AreTextsIdentical() const {
+int MyersDiff::ComputeEditDistance() const {
+    return *GetForwardDistance(UINT32_MAX, true);
+}
 
-    if (from_tokens_.size() != to_tokens_.size()) {
-        return false;
+std::optional<int> MyersDiff::WithinDistance(uint32_t max_distance) const {
+    if (auto distance = GetForwardDistance(max_distance, false)) {
+        return *distance;
     }
+    return std::nullopt;
+}
+
+std::optional<uint32_t> MyersDiff::GetForwardDistance(uint32_t max_distance, bool allow_bit_parallel) const {
+    // Отрезанные части и общие концы окна в расстояние не входят
+    uint32_t common_size = std::min(from_tokens_.size(), to_tokens_.size());
+    uint32_t prefix = CommonPrefixLength(from_tokens_.data(), to_tokens_.data(), common_size);
+    uint32_t suffix = CommonSuffixLength(from_tokens_.data() + from_tokens_.size(),
+                                         to_tokens_.data() + to_tokens_.size(),
+                                         common_size - prefix);
     
-    for (size_t i = 0; i < from_tokens_.size(); ++i) {
-        if (from_tokens_[i] != to_tokens_[i]) {
-            return false;
+    const TokenId* from_tokens = from_tokens_.data() + prefix;
+    const TokenId* to_tokens = to_tokens_.data() + prefix;
+    uint32_t from_size = from_tokens_.size() - prefix - suffix;
+    uint32_t to_size = to_tokens_.size() - prefix - suffix;
+    uint32_t total_size = from_size + to_size;
+    // Каждая правка меняет разность длин не больше чем на единицу
+    uint32_t delta = from_size > to_size ? from_size - to_size : to_size - from_size;
+    if (delta > max_distance) {
+        return std::nullopt;
+    }
+    if (from_size == 0 || to_size == 0) {
+        return total_size;
+    }
+    
+    // Шаг script_size затрагивает только диагонали |k| <= script_size, так что
+    // предел расстояния сразу ограничивает полосу диагоналей и память под нее.
+    // Пробный поиск средней змейки в PreferBitParallel резервирует память сам.
+    uint32_t last_step = std::min(total_size, max_distance);
+    uint32_t offset = last_step + 1;
+    WorkspaceLease lease(options_.workspace);
+    MyersWorkspace& workspace = lease.Get();
+    
+    SnakeSearch<TokenId> search{from_tokens, to_tokens, workspace, 0, nullptr};
+    if (allow_bit_parallel &&
+        (options_.algorithm == DiffAlgorithm::BIT_PARALLEL || PreferBitParallel(search, from_size, to_size))) {
+        if (auto lcs = GetBitParallelLcsLength(from_tokens, from_size, to_tokens, to_size,
+                                               kBitParallelMaxAlphabet)) {
+            return total_size - 2 * *lcs;
         }
     }
     
-    return true;
+    // Прямой проход Майерса: max_path[offset + k] - самая дальняя точка
+    // диагонали k = from_id - to_id после script_size правок
+    workspace.Reserve(offset * 2 + 1);
+    uint32_t* max_path = workspace.DirectPath();
+    max_path[offset + 1] = 0;
+    for (uint32_t script_size = 0; script_size <= last_step; ++script_size) {
+        for (uint32_t diagonal = offset - script_size; diagonal <= offset + script_size; diagonal += 2) {
+            uint32_t from_id;
+            if (diagonal == offset - script_size ||
+                (diagonal != offset + script_size && max_path[diagonal - 1] < max_path[diagonal + 1])) {
+                from_id = max_path[diagonal + 1];
+            } else {
+                from_id = max_path[diagonal - 1] + 1;
+            }
+            uint32_t to_id = from_id + offset - diagonal;
+            
+            if (from_id < from_size && to_id < to_size && from_tokens[from_id] == to_tokens[to_id]) {
+                uint32_t snake_length = CommonPrefixLength(from_tokens + from_id, to_tokens + to_id,
+                                                           std::min(from_size - from_id, to_size - to_id));
+                from_id += snake_length;
+                to_id += snake_length;
+            }
+            
+            max_path[diagonal] = from_id;
+            if (from_id == from_size && to_id == to_size) {
+                return script_size;
+            }
+        }
+    }
+    
+    return std::nullopt;
 }
+
+bool MyersDiff::AreTextsIdentical() const {
+
+    if (from_tokens_.size() != to_tokens_.size()) {
+        return false;
+    }
+    
+    return CommonPrefixLength(from_tokens_.data(), to_tokens_.data(), from_tokens_.size()) ==
+           from_tokens_.size();
+}
\ No newline at end of file
@@ -4,6 +4,13 @@
 #include <vector>
 #include <utility>
 #include <stdexcept>
+#include <mutex>
+#include <optional>
+#include <functional>
+#include <atomic>
+
+class ThreadPool;
+class TaskGroup;
 
 class Snake {
 public:
@@ -28,6 +35,123 @@ struct Replacement {
 
 using EditScript = std::vector<Replacement>;
 
+// Получатель замен, выдаваемых по одной в порядке позиций
+using ReplacementSink = std::function<void(const Replacement&)>;
+
+// Рабочая память поиска средней змейки: самые дальние точки на диагоналях
+// для прямого и обратного проходов. Растет вместе с числом шагов поиска
+// и переиспользуется всеми рекурсивными вызовами и, при необходимости,
+// несколькими экземплярами MyersDiff.
+class MyersWorkspace {
+public:
+    // Захват памяти одним расчетом. Константные методы MyersDiff можно
+    // звать из нескольких потоков: расчет, не захвативший общую память,
+    // заводит свою.
+    bool TryAcquire();
+    void Release();
+
+    void Reserve(uint32_t diagonals_count);
+    // Сдвигает первые diagonals_count диагоналей на shift вверх,
+    // освобождая по shift диагоналей с обеих сторон
+    void Shift(uint32_t diagonals_count, uint32_t shift);
+
+    uint32_t* DirectPath();
+    int32_t* ReversedPath();
+
+private:
+    std::vector<uint32_t> max_direct_path_;
+    std::vector<int32_t> max_reversed_path_;
+    std::atomic<bool> busy_{false};
+};
+
+// Отметки совпавших токенов одной стороны окна, бит на токен. Совпадения
+// идут в обоих текстах в одном порядке, поэтому k-й отмеченный токен from
+// стоит в паре с k-м отмеченным токеном to, и метки змеек не нужны.
+class MatchBitmap {
+public:
+    explicit MatchBitmap(uint32_t size);
+
+    // Отмечает [begin, end). Задачи декомпозиции в разных потоках отмечают
+    // непересекающиеся отрезки, а общие слова на их краях дописываются атомарно.
+    void MarkRange(uint32_t begin, uint32_t end);
+    // Отмечает один токен без синхронизации
+    void Mark(uint32_t id);
+
+    // Первый отмеченный (неотмеченный) токен в [id, end), или end
+    uint32_t FindMatched(uint32_t id, uint32_t end) const;
+    uint32_t FindUnmatched(uint32_t id, uint32_t end) const;
+    uint32_t Size() const;
+
+private:
+    uint32_t Find(uint32_t id, uint32_t end, uint64_t invert) const;
+
+    std::vector<uint64_t> words_;
+    uint32_t size_;
+};
+
+// Счетчики путей декомпозиции: по ним тесты и профилирование видят, какой
+// движок на самом деле работал. Можно делить между потоками и экземплярами.
+struct MyersDiffStats {
+    std::atomic<uint64_t> forked_tasks{0};       // Подзадачи, отданные в пул
+    std::atomic<uint64_t> concurrent_sweeps{0};  // Поиски средней змейки в два потока
+};
+
+enum class DiffAlgorithm {
+    MYERS,         // Минимальный скрипт алгоритмом Майерса
+    PATIENCE,      // Patience diff: деление по уникальным токенам, остаток - Майерсом
+    HISTOGRAM,     // Histogram diff: деление по самым редким общим отрезкам
+    BIT_PARALLEL   // Минимальный скрипт через бит-параллельную LCS и деление Хиршберга
+};
+
+struct MyersDiffOptions {
+    DiffAlgorithm algorithm = DiffAlgorithm::MYERS;
+    // Для MYERS: сначала искать скрипт одним прямым проходом, сохраняя фронты
+    // всех шагов - порядка 2 * D^2 байт. Без повторного сканирования змеек
+    // рекурсией это быстрее, пока D не больше sqrt(N + M) / 2. При большем D
+    // или если фронты не помещаются в greedy_trace_bytes, проход бросается
+    // и работает деление по средней змейке. Если одна сторона окна больше чем
+    // вдвое длиннее другой, прежде пробуется проход O(NP) Ву - Манбера -
+    // Майерса со следом в тех же пределах. 0 - не пробовать ни тот, ни другой.
+    size_t greedy_trace_bytes = 1 << 24;
+    // Для HISTOGRAM: токены, встречающиеся в диапазоне чаще, не служат якорями
+    uint32_t max_chain_length = 64;
+    // Для MYERS в посимвольном режиме: окна от bit_parallel_cutoff токенов
+    // с большим расстоянием считаются бит-параллельно
+    uint32_t bit_parallel_cutoff = 1 << 15;
+    // Внешняя рабочая память для пакетной обработки. Одновременно ее занимает
+    // один расчет, остальные (из других потоков или MyersDiff) заводят свою,
+    // как и без нее.
+    MyersWorkspace* workspace = nullptr;
+    // Не токенизировать совпадающие байты в начале и конце текстов
+    bool skip_common_bytes = true;
+    // Искать змейки только среди токенов, встречающихся в обоих текстах,
+    // как GNU diff: LCS от этого не меняется, а окно сжимается
+    bool discard_unmatched = true;
+    // Пул для параллельной декомпозиции: подзадачи с суммарной длиной не
+    // меньше parallel_cutoff токенов отдаются в пул, меньшие решаются на месте.
+    // Результат не зависит от пула и совпадает с последовательным.
+    ThreadPool* thread_pool = nullptr;
+    uint32_t parallel_cutoff = 1 << 14;
+    // С пулом: сначала резать окно по уникальным общим токенам на независимые
+    // куски от parallel_cutoff токенов и считать куски одновременно. Верхний
+    // уровень больше не последовательный, но скрипт может быть не минимальным.
+    bool chunk_by_anchors = false;
+    // Вести прямой и обратный проходы поиска средней змейки в двух потоках
+    // для подзадач с суммарной длиной от concurrent_sweeps_cutoff токенов
+    bool concurrent_sweeps = false;
+    uint32_t concurrent_sweeps_cutoff = 1 << 20;
+    // Предел числа шагов поиска средней змейки, как "too expensive" в GNU diff:
+    // после него задача делится в самой продвинувшейся точке, и скрипт (а с ним
+    // и расстояние) может оказаться не минимальным. 0 - без ограничения.
+    uint32_t max_cost = 0;
+    // Выбирать предел по размеру задачи: порядка sqrt(N + M), но не меньше 4096
+    bool heuristic = false;
+    // Всегда искать минимальный скрипт, игнорируя max_cost и heuristic
+    bool minimal = false;
+    // Куда считать пути декомпозиции, если нужно
+    MyersDiffStats* stats = nullptr;
+};
+
 enum class DiffFormat {
     UNIFIED,  // Унифицированный формат (как в `diff -u`)
     CONTEXT,  // Контекстный формат (как в `diff -c`)
@@ -39,32 +163,178 @@ public:
 
     MyersDiff(std::unique_ptr<UniversalTokenizer> tokenizer, 
               const std::string& text1, 
-              const std::string& text2);
+              const std::string& text2,
+              const MyersDiffOptions& options = {});
     
     std::vector<TokenId> GetLargestCommonSubsequence() const;
     EditScript GetShortestEditScript() const;
+    // Тот же скрипт, но каждая замена отдается в sink, как только декомпозиция
+    // разметила все левее нее: вывод начинается до того, как посчитана правая
+    // часть окна. С пулом потоков замены выдаются после декомпозиции.
+    // Скрипт не кэшируется и при повторном вызове считается заново.
+    void StreamShortestEditScript(const ReplacementSink& sink) const;
     std::string GetDiff(DiffFormat format = DiffFormat::UNIFIED, int context_size = 3) const;
+    // Ханки унифицированного формата без заголовка файлов, с номерами позиций,
+    // сдвинутыми на from_offset и to_offset: для вывода diff по частям
+    std::string GetUnifiedHunks(const EditScript& script, int context_size,
+                                uint64_t from_offset, uint64_t to_offset) const;
     
     int GetLevenshteinDistance() const;
+    // Минимальное расстояние без построения скрипта: только прямой проход
+    // Майерса (или бит-параллельная LCS) с памятью O(N + M). Не зависит
+    // от algorithm и ограничений стоимости поиска.
+    int ComputeEditDistance() const;
+    // Расстояние, если оно не больше max_distance: проход останавливается,
+    // как только предел превышен. Иначе nullopt.
+    std::optional<int> WithinDistance(uint32_t max_distance) const;
     
     bool AreTextsIdentical() const;
 
 private:
-    std::pair<uint32_t, Snake> GetMiddleSnake(uint32_t from_left, uint32_t from_right, 
+    // Окно поиска змеек: индексы внутри окна отсчитываются от указателей
+    // from_tokens и to_tokens, рабочая память общая для всей декомпозиции.
+    // Symbol - ширина хранения токенов: окно с небольшим словарем
+    // перекодируется в плотные номера по 1-2 байта.
+    using ResolvedCallback = std::function<void(uint32_t, uint32_t)>;
+
+    template <typename Symbol>
+    struct SnakeSearch {
+        const Symbol* from_tokens;
+        const Symbol* to_tokens;
+        MyersWorkspace& workspace;
+        uint32_t max_cost;  // 0 - поиск без ограничения стоимости
+        // Сообщает, что окно левее (from_id, to_id) размечено окончательно.
+        // Только для последовательной декомпозиции, иначе nullptr.
+        const ResolvedCallback* resolved;
+    };
+
+    struct MiddleSnakeState;
+
+    template <typename Symbol>
+    std::pair<uint32_t, Snake> GetMiddleSnake(const SnakeSearch<Symbol>& search,
+                                          uint32_t from_left, uint32_t from_right, 
                                           uint32_t to_left, uint32_t to_right) const;
+    template <typename Symbol>
+    std::pair<uint32_t, Snake> GetMiddleSnakeConcurrently(const SnakeSearch<Symbol>& search,
+                                                      MiddleSnakeState& state) const;
+
+    // Шаги прямого и обратного проходов с длиной пути script_size
+    template <typename Symbol>
+    std::optional<Snake> ForwardStep(const SnakeSearch<Symbol>& search, MiddleSnakeState& state,
+                                     uint32_t script_size, bool check_overlap) const;
+    template <typename Symbol>
+    std::optional<Snake> ReverseStep(const SnakeSearch<Symbol>& search, MiddleSnakeState& state,
+                                     uint32_t script_size, bool check_overlap) const;
+    int32_t ReverseStart(const MiddleSnakeState& state, uint32_t script_size, uint32_t diagonal) const;
+    std::optional<Snake> ReverseOverlap(const MiddleSnakeState& state, uint32_t script_size,
+                                        uint32_t diagonal) const;
+    // Расширяет память поиска, если шаг script_size в нее не помещается
+    void ReserveDiagonals(MyersWorkspace& workspace, MiddleSnakeState& state, uint32_t script_size) const;
+    std::optional<Snake> GetExpensiveSplit(const MiddleSnakeState& state, uint32_t script_size) const;
+    uint32_t GetMaxCost(uint32_t total_size) const;
+    std::optional<uint32_t> GetForwardDistance(uint32_t max_distance, bool allow_bit_parallel) const;
+    template <typename Symbol>
+    bool PreferBitParallel(const SnakeSearch<Symbol>& search, uint32_t from_size, uint32_t to_size) const;
     
-    void GetSnakeDecomposition(uint32_t from_left, uint32_t from_right, 
+    template <typename Symbol>
+    void GetSnakeDecomposition(const SnakeSearch<Symbol>& search,
+                              uint32_t from_left, uint32_t from_right, 
                               uint32_t to_left, uint32_t to_right,
-                              std::vector<int32_t>& from_snake,
-                              std::vector<int32_t>& to_snake, 
-                              uint32_t& current_snake) const;
+                              MatchBitmap& from_matched,
+                              MatchBitmap& to_matched, 
+                              TaskGroup* group) const;
+
+    template <typename Symbol>
+    void ForkSnakeDecomposition(const SnakeSearch<Symbol>& search,
+                                uint32_t from_left, uint32_t from_right,
+                                uint32_t to_left, uint32_t to_right,
+                                MatchBitmap& from_matched,
+                                MatchBitmap& to_matched,
+                                TaskGroup& group) const;
+
+    // Прямой проход по всему окну с сохранением фронтов всех шагов и обратным
+    // ходом по ним. false, если фронты не поместились в greedy_trace_bytes.
+    template <typename Symbol>
+    bool MarkGreedyPath(const SnakeSearch<Symbol>& search, uint32_t from_size, uint32_t to_size,
+                        MatchBitmap& from_matched, MatchBitmap& to_matched) const;
+
+    // Алгоритм O(NP) для окон, где одна сторона больше чем вдвое длиннее
+    // другой. false, если окно сбалансировано или след не поместился.
+    template <typename Symbol>
+    bool MarkUnbalancedPath(const SnakeSearch<Symbol>& search, uint32_t from_size, uint32_t to_size,
+                            MatchBitmap& from_matched, MatchBitmap& to_matched) const;
+
+    // Подзадача в пару сотен клеток: динамика по таблице LCS на стеке
+    template <typename Symbol>
+    void MarkSmallSubproblem(const SnakeSearch<Symbol>& search,
+                             uint32_t from_left, uint32_t from_right,
+                             uint32_t to_left, uint32_t to_right,
+                             MatchBitmap& from_matched,
+                             MatchBitmap& to_matched) const;
+
+    template <typename Symbol>
+    void MarkShortSnakes(const SnakeSearch<Symbol>& search,
+                         uint32_t from_left, uint32_t from_right, 
+                         uint32_t to_left, uint32_t to_right,
+                         MatchBitmap& from_matched,
+                         MatchBitmap& to_matched) const;
+
+    void DecomposeWindow(const TokenId* from_tokens, const TokenId* to_tokens,
+                         MatchBitmap& from_matched, MatchBitmap& to_matched,
+                         const ResolvedCallback* resolved) const;
+    // Декомпозиция окна, токены которого уже перекодированы в from_symbols
+    // и to_symbols; исходные нужны построителям сегментов
+    template <typename Symbol>
+    void DecomposeSymbols(const TokenId* from_tokens, const TokenId* to_tokens,
+                          const Symbol* from_symbols, const Symbol* to_symbols,
+                          MatchBitmap& from_matched, MatchBitmap& to_matched,
+                          const ResolvedCallback* resolved) const;
+    void DecomposeMatchable(const TokenId* from_tokens, const TokenId* to_tokens,
+                            MatchBitmap& from_matched, MatchBitmap& to_matched,
+                            const ResolvedCallback* resolved) const;
+
+    EditScript ComputeShortestEditScript() const;
+    // streaming - выдавать замены по ходу последовательной декомпозиции
+    void EmitShortestEditScript(const ReplacementSink& sink, bool streaming) const;
+    const EditScript& GetCachedEditScript() const;
+
+    void SkipCommonBytes(const std::string& text1, const std::string& text2,
+                         size_t& prefix_bytes, size_t& suffix_bytes) const;
+
+    // Позиции отсчитываются от начала всего документа, включая отрезанные байты
+    uint32_t FromSize() const;
+    uint32_t ToSize() const;
+    TokenId GetToken(const std::vector<TokenId>& window, uint32_t id) const;
+    std::string DecodeToken(TokenId token) const;
+    void LoadSkippedTokens() const;
     
     std::string FormatUnifiedDiff(const EditScript& script, int context_size) const;
     std::string FormatContextDiff(const EditScript& script, int context_size) const;
     std::string FormatNormalDiff(const EditScript& script) const;
 
     std::unique_ptr<UniversalTokenizer> tokenizer_;
+    MyersDiffOptions options_;
     
+    // Токены отличающейся середины текстов
     std::vector<TokenId> from_tokens_;
     std::vector<TokenId> to_tokens_;
+
+    // Совпадающие начало и конец текстов. Конструктор только считает их
+    // токены, сами токены нужны лишь для LCS и широкого контекста вывода,
+    // поэтому байты копируются: объект не зависит от строк вызывающего
+    std::string skipped_prefix_;
+    std::string skipped_suffix_;
+    uint32_t skipped_prefix_size_ = 0;
+    uint32_t skipped_suffix_size_ = 0;
+    mutable std::once_flag skipped_once_;
+    mutable std::vector<TokenId> skipped_prefix_tokens_;
+    mutable std::vector<TokenId> skipped_suffix_tokens_;
+    // Encode дополняет словарь, поэтому после конструктора все обращения
+    // к токенизатору идут под этим мьютексом
+    mutable std::mutex tokenizer_mutex_;
+
+    // Скрипт считается один раз при первом обращении и затем разделяется
+    // всеми форматами и метриками, в том числе из нескольких потоков
+    mutable std::once_flag script_once_;
+    mutable EditScript script_;
 };
@@ -0,0 +1,271 @@
+#include "StreamingDiff.h"
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+namespace {
+
+// Общий участок для синхронизации после длинной правки - столько строк
+// подряд: одиночные пустые строки и скобки встречаются слишком часто
+constexpr size_t kAnchorLines = 3;
+
+size_t GetRunHash(const std::vector<size_t>& line_hashes, size_t start) {
+    size_t hash = 0;
+    for (size_t i = start; i < start + kAnchorLines; ++i) {
+        hash = hash * 1000003 ^ line_hashes[i];
+    }
+    return hash;
+}
+
+}  // namespace
+
+StreamingDiff::StreamingDiff(UniversalTokenizerMode mode, const StreamingDiffOptions& options)
+    : mode_(mode), options_(options), counter_(CreateTokenizer(mode)) {
+}
+
+bool StreamingDiff::Run(std::istream& from, std::istream& to, std::ostream& out) {
+    Window from_window;
+    Window to_window;
+    from_window.input = &from;
+    to_window.input = &to;
+    bool identical = true;
+    
+    while (true) {
+        Fill(from_window);
+        Fill(to_window);
+        if (from_window.lines.empty() && to_window.lines.empty()) {
+            break;
+        }
+        
+        std::vector<uint32_t> from_starts = GetLineStarts(from_window);
+        std::vector<uint32_t> to_starts = GetLineStarts(to_window);
+        MyersDiff diff(CreateTokenizer(mode_), Join(from_window, from_window.lines.size()),
+                       Join(to_window, to_window.lines.size()), options_.diff_options);
+        EditScript script = diff.GetShortestEditScript();
+        
+        // Без точки синхронизации окна сдвигаются к общему участку дальше
+        // в файлах, а если нет и его - выводятся целиком
+        bool is_last = from_window.exhausted && to_window.exhausted;
+        size_t from_lines = from_window.lines.size();
+        size_t to_lines = to_window.lines.size();
+        if (!is_last &&
+            !FindCut(script, from_starts, to_starts,
+                     from_window.exhausted ? from_starts.back() : from_starts.back() / 2,
+                     to_window.exhausted ? to_starts.back() : to_starts.back() / 2,
+                     from_lines, to_lines) &&
+            Resync(from_window, to_window, out, identical)) {
+            continue;
+        }
+        
+        // Точка синхронизации лежит в неизмененном участке, поэтому каждая
+        // замена целиком до нее или целиком после
+        EditScript emitted;
+        for (const auto& rep : script) {
+            if (rep.from_right <= from_starts[from_lines] && rep.to_right <= to_starts[to_lines]) {
+                emitted.push_back(rep);
+            }
+        }
+        
+        EmitHunks(diff, emitted, from_window, to_window, out, identical);
+        
+        Advance(from_window, from_lines, from_starts);
+        Advance(to_window, to_lines, to_starts);
+        if (is_last) {
+            break;
+        }
+    }
+    
+    return identical;
+}
+
+void StreamingDiff::Fill(Window& window) const {
+    while (window.bytes < options_.window_bytes && ReadLine(window)) {
+    }
+}
+
+bool StreamingDiff::ReadLine(Window& window) const {
+    if (window.exhausted) {
+        return false;
+    }
+    
+    std::string line;
+    if (!std::getline(*window.input, line)) {
+        window.exhausted = true;
+        return false;
+    }
+    if (window.input->eof()) {
+        window.exhausted = true;
+    } else {
+        line += '\n';
+    }
+    
+    // Конец строки - граница токена, поэтому токены окна - это токены его строк
+    window.line_tokens.push_back(counter_->CountTokens(line));
+    window.bytes += line.size();
+    window.lines.push_back(std::move(line));
+    return true;
+}
+
+std::string StreamingDiff::Join(const Window& window, size_t lines_count) const {
+    std::string text;
+    text.reserve(window.bytes);
+    for (size_t i = 0; i < lines_count; ++i) {
+        text += window.lines[i];
+    }
+    return text;
+}
+
+std::vector<uint32_t> StreamingDiff::GetLineStarts(const Window& window) const {
+    std::vector<uint32_t> starts(1, 0);
+    for (uint32_t tokens : window.line_tokens) {
+        starts.push_back(starts.back() + tokens);
+    }
+    return starts;
+}
+
+bool StreamingDiff::FindCut(const EditScript& script,
+                            const std::vector<uint32_t>& from_starts, const std::vector<uint32_t>& to_starts,
+                            uint32_t from_limit, uint32_t to_limit,
+                            size_t& from_lines, size_t& to_lines) const {
+    // Неизмененные участки между заменами, включая начало и конец окна
+    std::vector<Replacement> stretches;
+    uint32_t from_id = 0;
+    uint32_t to_id = 0;
+    for (const auto& rep : script) {
+        stretches.push_back({from_id, rep.from_left, to_id, rep.to_left});
+        from_id = rep.from_right;
+        to_id = rep.to_right;
+    }
+    stretches.push_back({from_id, from_starts.back(), to_id, to_starts.back()});
+    
+    // Берется самая поздняя точка, после которой в участке остается контекст
+    // следующего ханка
+    uint32_t context_size = std::max(options_.context_size, 0);
+    for (auto it = stretches.rbegin(); it != stretches.rend(); ++it) {
+        uint32_t length = it->from_right - it->from_left;
+        uint32_t highest = it->from_right - std::min(context_size, length);
+        highest = std::min(highest, from_limit);
+        if (to_limit < it->to_left || highest < it->from_left) {
+            continue;
+        }
+        highest = std::min(highest, it->from_left + (to_limit - it->to_left));
+        
+        auto from_start = std::upper_bound(from_starts.begin(), from_starts.end(), highest);
+        while (from_start != from_starts.begin() && *(from_start - 1) >= it->from_left) {
+            --from_start;
+            uint32_t to_cut = it->to_left + (*from_start - it->from_left);
+            auto to_start = std::lower_bound(to_starts.begin(), to_starts.end(), to_cut);
+            if (to_start == to_starts.end() || *to_start != to_cut || *from_start + to_cut == 0) {
+                continue;
+            }
+            
+            // Пустые строки дают несколько начал с одной позицией: берется первое
+            from_lines = std::lower_bound(from_starts.begin(), from_starts.end(), *from_start) - from_starts.begin();
+            to_lines = to_start - to_starts.begin();
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool StreamingDiff::Resync(Window& from_window, Window& to_window, std::ostream& out, bool& identical) const {
+    // Участки из kAnchorLines строк индексируются по хешам. Сначала ищем общий
+    // участок в уже прочитанных окнах, затем дочитываем обе стороны по строке,
+    // пока участок не найдется: сторона с длинной вставкой уйдет вперед
+    struct Side {
+        Window& window;
+        size_t max_bytes;
+        std::vector<size_t> line_hashes;
+        std::unordered_map<size_t, size_t> runs;  // Хеш участка -> первая строка
+    };
+    Side from{from_window, from_window.bytes + options_.resync_bytes, {}, {}};
+    Side to{to_window, to_window.bytes + options_.resync_bytes, {}, {}};
+    
+    // Из найденных участков берется ближайший к началу окон. Участок в начале
+    // обоих окон не сдвинул бы их, его пропускаем.
+    size_t from_anchor = 0;
+    size_t to_anchor = 0;
+    bool found = false;
+    auto add_line = [&](Side& side, Side& other, bool is_from) {
+        side.line_hashes.push_back(std::hash<std::string>{}(side.window.lines[side.line_hashes.size()]));
+        if (side.line_hashes.size() < kAnchorLines) {
+            return;
+        }
+        size_t start = side.line_hashes.size() - kAnchorLines;
+        size_t run = GetRunHash(side.line_hashes, start);
+        side.runs.emplace(run, start);
+        
+        auto it = other.runs.find(run);
+        if (it == other.runs.end()) {
+            return;
+        }
+        size_t from_start = is_from ? start : it->second;
+        size_t to_start = is_from ? it->second : start;
+        if (from_start + to_start > 0 && (!found || from_start + to_start < from_anchor + to_anchor)) {
+            from_anchor = from_start;
+            to_anchor = to_start;
+            found = true;
+        }
+    };
+    
+    while (from.line_hashes.size() < from_window.lines.size()) {
+        add_line(from, to, true);
+    }
+    while (to.line_hashes.size() < to_window.lines.size()) {
+        add_line(to, from, false);
+    }
+    while (!found) {
+        bool from_read = from_window.bytes < from.max_bytes && ReadLine(from_window);
+        bool to_read = to_window.bytes < to.max_bytes && ReadLine(to_window);
+        if (!from_read && !to_read) {
+            return false;
+        }
+        if (from_read) {
+            add_line(from, to, true);
+        }
+        if (to_read) {
+            add_line(to, from, false);
+        }
+    }
+    
+    // Участок - общий суффикс обоих текстов, и diff до него его не задевает.
+    // Если хеши совпали у разных строк, окна сдвигаются за участок целиком.
+    std::vector<uint32_t> from_starts = GetLineStarts(from_window);
+    std::vector<uint32_t> to_starts = GetLineStarts(to_window);
+    MyersDiff diff(CreateTokenizer(mode_), Join(from_window, from_anchor + kAnchorLines),
+                   Join(to_window, to_anchor + kAnchorLines), options_.diff_options);
+    EditScript script = diff.GetShortestEditScript();
+    if (!script.empty() && (script.back().from_right > from_starts[from_anchor] ||
+                            script.back().to_right > to_starts[to_anchor])) {
+        from_anchor += kAnchorLines;
+        to_anchor += kAnchorLines;
+    }
+    
+    EmitHunks(diff, script, from_window, to_window, out, identical);
+    Advance(from_window, from_anchor, from_starts);
+    Advance(to_window, to_anchor, to_starts);
+    return true;
+}
+
+void StreamingDiff::EmitHunks(const MyersDiff& diff, const EditScript& script, const Window& from_window,
+                              const Window& to_window, std::ostream& out, bool& identical) const {
+    if (script.empty()) {
+        return;
+    }
+    if (identical) {
+        out << "--- a" << std::endl;
+        out << "+++ b" << std::endl;
+        identical = false;
+    }
+    out << diff.GetUnifiedHunks(script, options_.context_size, from_window.offset, to_window.offset);
+}
+
+void StreamingDiff::Advance(Window& window, size_t lines_count, const std::vector<uint32_t>& starts) const {
+    window.offset += starts[lines_count];
+    for (size_t i = 0; i < lines_count; ++i) {
+        window.bytes -= window.lines.front().size();
+        window.lines.pop_front();
+        window.line_tokens.pop_front();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "MyersDiff.h"
+#include <deque>
+#include <istream>
+#include <ostream>
+
+struct StreamingDiffOptions {
+    // Сколько байт каждого файла держится в памяти одновременно. Строка
+    // длиннее окна читается целиком.
+    size_t window_bytes = 1 << 24;
+    // Если в окнах нет точки синхронизации, каждый файл дочитывается еще
+    // на столько байт в поисках общего участка: вставка или удаление длиннее
+    // выводятся окнами целиком
+    size_t resync_bytes = 1 << 26;
+    int context_size = 3;
+    MyersDiffOptions diff_options;
+};
+
+// Diff файлов, не помещающихся в память. Оба потока читаются окнами по
+// строкам, окна сравниваются MyersDiff. Точка синхронизации - начало строки
+// в обоих окнах внутри неизмененного участка первой половины окна: ханки до
+// нее сразу выводятся, и окна сдвигаются к ней. Если такой точки нет (правка
+// длиннее половины окна), оба файла дочитываются до первого общего участка
+// из нескольких строк, найденного по хешам строк, и каждое окно сдвигается
+// к нему на свое число строк. Не нашелся и он - окна выводятся целиком:
+// diff остается корректным, но может быть не минимальным.
+class StreamingDiff {
+public:
+    explicit StreamingDiff(UniversalTokenizerMode mode, const StreamingDiffOptions& options = {});
+
+    // Пишет унифицированный diff в out по мере чтения; true, если различий нет
+    bool Run(std::istream& from, std::istream& to, std::ostream& out);
+
+private:
+    struct Window {
+        std::istream* input = nullptr;
+        std::deque<std::string> lines;
+        std::deque<uint32_t> line_tokens;
+        size_t bytes = 0;
+        uint64_t offset = 0;  // Токенов до начала окна
+        bool exhausted = false;
+    };
+
+    void Fill(Window& window) const;
+    // Дочитывает одну строку; false, если файл кончился
+    bool ReadLine(Window& window) const;
+    // Текст первых lines_count строк окна
+    std::string Join(const Window& window, size_t lines_count) const;
+    // Начала строк окна в токенах, от 0 до числа токенов окна включительно
+    std::vector<uint32_t> GetLineStarts(const Window& window) const;
+    bool FindCut(const EditScript& script,
+                 const std::vector<uint32_t>& from_starts, const std::vector<uint32_t>& to_starts,
+                 uint32_t from_limit, uint32_t to_limit, size_t& from_lines, size_t& to_lines) const;
+    bool Resync(Window& from_window, Window& to_window, std::ostream& out, bool& identical) const;
+    void EmitHunks(const MyersDiff& diff, const EditScript& script, const Window& from_window,
+                   const Window& to_window, std::ostream& out, bool& identical) const;
+    void Advance(Window& window, size_t lines_count, const std::vector<uint32_t>& starts) const;
+
+    UniversalTokenizerMode mode_;
+    StreamingDiffOptions options_;
+    std::unique_ptr<UniversalTokenizer> counter_;
+};
@@ -0,0 +1,158 @@
+#include "ThreadPool.h"
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads_count) {
+    if (threads_count == 0) {
+        threads_count = 1;
+    }
+    
+    for (size_t i = 0; i <= threads_count; ++i) {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    
+    for (size_t i = 0; i < threads_count; ++i) {
+        workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::Size() const {
+    return workers_.size();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    // Счетчик растет до публикации задачи и под sleep_mutex_: так он не уходит
+    // в минус, а засыпающий поток не пропускает сигнал
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++queued_;
+    }
+    
+    TaskQueue& queue = *queues_[HomeQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::RunPendingTask() {
+    std::function<void()> task;
+    if (!PopTask(HomeQueue(), task)) {
+        return false;
+    }
+    
+    task();
+    return true;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    
+    while (true) {
+        std::function<void()> task;
+        if (PopTask(index, task)) {
+            task();
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+        if (stopping_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::HomeQueue() const {
+    return current_pool == this ? current_worker : workers_.size();
+}
+
+bool ThreadPool::PopTask(size_t home, std::function<void()>& task) {
+    // Свою очередь разбираем с конца: последние задачи самые горячие в кэше
+    {
+        TaskQueue& queue = *queues_[home];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+    
+    // Чужие очереди разбираем с начала: там лежат самые крупные подзадачи
+    for (size_t shift = 1; shift < queues_.size(); ++shift) {
+        TaskQueue& queue = *queues_[(home + shift) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+    : pool_(pool) {
+}
+
+TaskGroup::~TaskGroup() {
+    // Задачи ссылаются на группу, поэтому без ожидания ее нельзя разрушить
+    while (pending_ > 0) {
+        if (!pool_.RunPendingTask()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskGroup::Run(std::function<void()> task) {
+    ++pending_;
+    pool_.Submit([this, task = std::move(task)] {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        --pending_;
+    });
+}
+
+void TaskGroup::Wait() {
+    while (pending_ > 0) {
+        if (!pool_.RunPendingTask()) {
+            std::this_thread::yield();
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом работы: у каждого потока своя очередь, из которой
+// он берет задачи с конца, а простаивающие потоки забирают задачи у соседей
+// с начала очереди
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t Size() const;
+
+    void Submit(std::function<void()> task);
+    // Выполняет одну ожидающую задачу в текущем потоке, если она есть
+    bool RunPendingTask();
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    size_t HomeQueue() const;
+    bool PopTask(size_t home, std::function<void()>& task);
+
+    // Последняя очередь принимает задачи от потоков вне пула
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    std::atomic<size_t> queued_{0};
+    bool stopping_ = false;
+};
+
+// Группа задач fork-join. Ожидающий поток не простаивает, а выполняет
+// задачи пула, поэтому задачи группы могут сами добавлять новые задачи
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool);
+    ~TaskGroup();
+
+    void Run(std::function<void()> task);
+    // Дожидается всех задач группы и пробрасывает первое исключение
+    void Wait();
+
+private:
+    ThreadPool& pool_;
+    std::atomic<size_t> pending_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
@@ -0,0 +1,249 @@
+#include "TokenMatch.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define TOKEN_MATCH_X86
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TOKEN_MATCH_NEON
+#endif
+
+namespace {
+
+// Сравниваем по машинному слову: в uint64_t помещается 8 / sizeof(Symbol) токенов
+uint64_t LoadWord(const void* tokens) {
+    uint64_t word;
+    std::memcpy(&word, tokens, sizeof(word));
+    return word;
+}
+
+template <typename Symbol>
+size_t CommonPrefixLengthScalar(const Symbol* from, const Symbol* to, size_t limit) {
+    constexpr size_t kTokensPerWord = sizeof(uint64_t) / sizeof(Symbol);
+    size_t length = 0;
+
+    while (length + kTokensPerWord <= limit &&
+           LoadWord(from + length) == LoadWord(to + length)) {
+        length += kTokensPerWord;
+    }
+
+    while (length < limit && from[length] == to[length]) {
+        ++length;
+    }
+
+    return length;
+}
+
+template <typename Symbol>
+size_t CommonSuffixLengthScalar(const Symbol* from_end, const Symbol* to_end, size_t limit) {
+    constexpr size_t kTokensPerWord = sizeof(uint64_t) / sizeof(Symbol);
+    size_t length = 0;
+
+    while (length + kTokensPerWord <= limit &&
+           LoadWord(from_end - length - kTokensPerWord) == LoadWord(to_end - length - kTokensPerWord)) {
+        length += kTokensPerWord;
+    }
+
+    while (length < limit && from_end[-1 - static_cast<ptrdiff_t>(length)] ==
+                             to_end[-1 - static_cast<ptrdiff_t>(length)]) {
+        ++length;
+    }
+
+    return length;
+}
+
+#ifdef TOKEN_MATCH_X86
+
+// Маска совпадений по байтам: токен занимает sizeof(Symbol) соседних битов,
+// и все они выставлены, если i-е токены блока совпали
+template <typename Symbol>
+__attribute__((target("avx2")))
+uint32_t EqualMaskAvx2(const Symbol* from, const Symbol* to) {
+    __m256i lhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from));
+    __m256i rhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(to));
+    __m256i equal;
+    if constexpr (sizeof(Symbol) == 1) {
+        equal = _mm256_cmpeq_epi8(lhs, rhs);
+    } else if constexpr (sizeof(Symbol) == 2) {
+        equal = _mm256_cmpeq_epi16(lhs, rhs);
+    } else {
+        equal = _mm256_cmpeq_epi32(lhs, rhs);
+    }
+    return _mm256_movemask_epi8(equal);
+}
+
+template <typename Symbol>
+__attribute__((target("avx2")))
+size_t CommonPrefixLengthAvx2(const Symbol* from, const Symbol* to, size_t limit) {
+    constexpr size_t kBlock = 32 / sizeof(Symbol);
+    size_t length = 0;
+
+    for (; length + kBlock <= limit; length += kBlock) {
+        uint32_t mask = EqualMaskAvx2(from + length, to + length);
+        if (mask != 0xFFFFFFFF) {
+            return length + __builtin_ctz(~mask) / sizeof(Symbol);
+        }
+    }
+
+    return length + CommonPrefixLengthScalar(from + length, to + length, limit - length);
+}
+
+template <typename Symbol>
+__attribute__((target("avx2")))
+size_t CommonSuffixLengthAvx2(const Symbol* from_end, const Symbol* to_end, size_t limit) {
+    constexpr size_t kBlock = 32 / sizeof(Symbol);
+    size_t length = 0;
+
+    for (; length + kBlock <= limit; length += kBlock) {
+        uint32_t mask = EqualMaskAvx2(from_end - length - kBlock, to_end - length - kBlock);
+        if (mask != 0xFFFFFFFF) {
+            // Совпавшие токены в конце блока - старшие биты маски
+            return length + __builtin_clz(~mask) / sizeof(Symbol);
+        }
+    }
+
+    return length + CommonSuffixLengthScalar(from_end - length, to_end - length, limit - length);
+}
+
+template <typename Symbol>
+uint32_t EqualMaskSse2(const Symbol* from, const Symbol* to) {
+    __m128i lhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+    __m128i rhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to));
+    __m128i equal;
+    if constexpr (sizeof(Symbol) == 1) {
+        equal = _mm_cmpeq_epi8(lhs, rhs);
+    } else if constexpr (sizeof(Symbol) == 2) {
+        equal = _mm_cmpeq_epi16(lhs, rhs);
+    } else {
+        equal = _mm_cmpeq_epi32(lhs, rhs);
+    }
+    return _mm_movemask_epi8(equal);
+}
+
+template <typename Symbol>
+size_t CommonPrefixLengthSse2(const Symbol* from, const Symbol* to, size_t limit) {
+    constexpr size_t kBlock = 16 / sizeof(Symbol);
+    size_t length = 0;
+
+    for (; length + kBlock <= limit; length += kBlock) {
+        uint32_t mask = EqualMaskSse2(from + length, to + length);
+        if (mask != 0xFFFF) {
+            return length + __builtin_ctz(~mask) / sizeof(Symbol);
+        }
+    }
+
+    return length + CommonPrefixLengthScalar(from + length, to + length, limit - length);
+}
+
+template <typename Symbol>
+size_t CommonSuffixLengthSse2(const Symbol* from_end, const Symbol* to_end, size_t limit) {
+    constexpr size_t kBlock = 16 / sizeof(Symbol);
+    size_t length = 0;
+
+    for (; length + kBlock <= limit; length += kBlock) {
+        uint32_t mask = EqualMaskSse2(from_end - length - kBlock, to_end - length - kBlock);
+        if (mask != 0xFFFF) {
+            return length + __builtin_clz(~mask << 16) / sizeof(Symbol);
+        }
+    }
+
+    return length + CommonSuffixLengthScalar(from_end - length, to_end - length, limit - length);
+}
+
+#endif  // TOKEN_MATCH_X86
+
+#ifdef TOKEN_MATCH_NEON
+
+// Блок совпадает целиком тогда и только тогда, когда совпали все его байты,
+// поэтому проверка не зависит от ширины токена
+bool BlockEqualNeon(const void* from, const void* to) {
+    uint8x16_t lhs = vld1q_u8(static_cast<const uint8_t*>(from));
+    uint8x16_t rhs = vld1q_u8(static_cast<const uint8_t*>(to));
+    return vminvq_u8(vceqq_u8(lhs, rhs)) == 0xFF;
+}
+
+// NEON есть на любом aarch64, поэтому выбор делается при компиляции.
+// Блок с несовпадением досчитывается скалярно.
+template <typename Symbol>
+size_t CommonPrefixLengthNeon(const Symbol* from, const Symbol* to, size_t limit) {
+    constexpr size_t kBlock = 16 / sizeof(Symbol);
+    size_t length = 0;
+
+    while (length + kBlock <= limit && BlockEqualNeon(from + length, to + length)) {
+        length += kBlock;
+    }
+
+    return length + CommonPrefixLengthScalar(from + length, to + length, limit - length);
+}
+
+template <typename Symbol>
+size_t CommonSuffixLengthNeon(const Symbol* from_end, const Symbol* to_end, size_t limit) {
+    constexpr size_t kBlock = 16 / sizeof(Symbol);
+    size_t length = 0;
+
+    while (length + kBlock <= limit &&
+           BlockEqualNeon(from_end - length - kBlock, to_end - length - kBlock)) {
+        length += kBlock;
+    }
+
+    return length + CommonSuffixLengthScalar(from_end - length, to_end - length, limit - length);
+}
+
+#endif  // TOKEN_MATCH_NEON
+
+template <typename Symbol>
+struct MatchKernels {
+    using Kernel = size_t (*)(const Symbol*, const Symbol*, size_t);
+    
+    Kernel prefix;
+    Kernel suffix;
+};
+
+template <typename Symbol>
+MatchKernels<Symbol> SelectKernels() {
+#if defined(TOKEN_MATCH_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        return {CommonPrefixLengthAvx2<Symbol>, CommonSuffixLengthAvx2<Symbol>};
+    }
+    return {CommonPrefixLengthSse2<Symbol>, CommonSuffixLengthSse2<Symbol>};
+#elif defined(TOKEN_MATCH_NEON)
+    return {CommonPrefixLengthNeon<Symbol>, CommonSuffixLengthNeon<Symbol>};
+#else
+    return {CommonPrefixLengthScalar<Symbol>, CommonSuffixLengthScalar<Symbol>};
+#endif
+}
+
+// Ядра выбираются один раз по возможностям процессора
+template <typename Symbol>
+const MatchKernels<Symbol>& GetKernels() {
+    static const MatchKernels<Symbol> kernels = SelectKernels<Symbol>();
+    return kernels;
+}
+
+}  // namespace
+
+size_t CommonPrefixLength(const uint8_t* from, const uint8_t* to, size_t limit) {
+    return GetKernels<uint8_t>().prefix(from, to, limit);
+}
+
+size_t CommonPrefixLength(const uint16_t* from, const uint16_t* to, size_t limit) {
+    return GetKernels<uint16_t>().prefix(from, to, limit);
+}
+
+size_t CommonPrefixLength(const TokenId* from, const TokenId* to, size_t limit) {
+    return GetKernels<TokenId>().prefix(from, to, limit);
+}
+
+size_t CommonSuffixLength(const uint8_t* from_end, const uint8_t* to_end, size_t limit) {
+    return GetKernels<uint8_t>().suffix(from_end, to_end, limit);
+}
+
+size_t CommonSuffixLength(const uint16_t* from_end, const uint16_t* to_end, size_t limit) {
+    return GetKernels<uint16_t>().suffix(from_end, to_end, limit);
+}
+
+size_t CommonSuffixLength(const TokenId* from_end, const TokenId* to_end, size_t limit) {
+    return GetKernels<TokenId>().suffix(from_end, to_end, limit);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "UniversalTokenizer.h"
+#include <cstddef>
+#include <cstdint>
+
+// Длина общего префикса последовательностей from и to, не превосходящая limit.
+// Узкие варианты работают с токенами, перекодированными в плотные номера.
+size_t CommonPrefixLength(const uint8_t* from, const uint8_t* to, size_t limit);
+size_t CommonPrefixLength(const uint16_t* from, const uint16_t* to, size_t limit);
+size_t CommonPrefixLength(const TokenId* from, const TokenId* to, size_t limit);
+
+// Длина общего суффикса последовательностей, заканчивающихся перед from_end и to_end,
+// не превосходящая limit
+size_t CommonSuffixLength(const uint8_t* from_end, const uint8_t* to_end, size_t limit);
+size_t CommonSuffixLength(const uint16_t* from_end, const uint16_t* to_end, size_t limit);
+size_t CommonSuffixLength(const TokenId* from_end, const TokenId* to_end, size_t limit);
@@ -39,14 +39,7 @@ std::vector<std::string> UniversalTokenizer::SplitIntoUtf8Chars(const std::strin
     std::vector<std::string> chars;
     
     for (size_t i = 0; i < text.length(); ) {
-        int char_len = 1;
-        
-        // Определяем длину UTF-8 символа
-        if (parser_mode_ == UniversalParserMode::UTF_8) {
-            if ((text[i] & 0xE0) == 0xC0) char_len = 2;
-            else if ((text[i] & 0xF0) == 0xE0) char_len = 3;
-            else if ((text[i] & 0xF8) == 0xF0) char_len = 4;
-        }
+        size_t char_len = GetUtf8CharLength(text[i]);
         
         // Проверяем, не выходим ли за границы строки
         if (i + char_len <= text.length()) {
@@ -91,6 +84,87 @@ bool UniversalTokenizer::IsUtf8Char(char c) const {
     return parser_mode_ == UniversalParserMode::UTF_8 && (c & 0x80);
 }
 
+size_t UniversalTokenizer::GetUtf8CharLength(char c) const {
+    // Определяем длину UTF-8 символа по первому байту
+    if (parser_mode_ == UniversalParserMode::UTF_8) {
+        if ((c & 0xE0) == 0xC0) return 2;
+        if ((c & 0xF0) == 0xE0) return 3;
+        if ((c & 0xF8) == 0xF0) return 4;
+    }
+    return 1;
+}
+
+bool UniversalTokenizer::IsTokenBoundary(const std::string& text, size_t pos) const {
+    return pos == 0 || pos == text.length();
+}
+
+size_t UniversalTokenizer::CountTokens(std::string_view text) const {
+    return Encode(std::string(text)).size();
+}
+
+bool UniversalTokenizer::HasFastTokenCount() const {
+    return false;
+}
+
+bool UniversalTokenizer::IsCharBoundary(const std::string& text, size_t pos) const {
+    if (parser_mode_ == UniversalParserMode::BYTES || pos == text.length()) {
+        return true;
+    }
+    
+    // Разбиение на символы не проверяет байты продолжения, поэтому во
+    // входе с некорректной UTF-8 символ может захватить следующий ASCII-байт.
+    // Позиция гарантированно начинает символ, только если три предшествующих
+    // байта однобайтовые: более ранний символ не дотянется до pos.
+    for (size_t i = pos; i > 0 && i + 3 > pos; --i) {
+        if (text[i - 1] & 0x80) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool UniversalTokenizer::IsWordBoundary(const std::string& text, size_t pos) const {
+    if (pos == 0 || pos == text.length()) {
+        return true;
+    }
+    
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    return IsCharBoundary(text, pos) && (is_space(text[pos - 1]) || is_space(text[pos]));
+}
+
+size_t UniversalTokenizer::CountUtf8Chars(std::string_view text) const {
+    size_t count = 0;
+    
+    for (size_t i = 0; i < text.length(); i += GetUtf8CharLength(text[i])) {
+        ++count;
+    }
+    
+    return count;
+}
+
+size_t UniversalTokenizer::CountWords(std::string_view text) const {
+    size_t count = 0;
+    bool in_word = false;
+    
+    // Повторяет разбиение SplitIntoWords без создания строк
+    for (size_t i = 0; i < text.length(); ) {
+        size_t char_len = GetUtf8CharLength(text[i]);
+        char c = text[i];
+        
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            count += in_word ? 2 : 1;
+            in_word = false;
+        } else {
+            in_word = true;
+        }
+        
+        i += char_len;
+    }
+    
+    return count + (in_word ? 1 : 0);
+}
+
 BPETokenizer::BPETokenizer(UniversalParserMode parser_mode)
     : UniversalTokenizer(parser_mode) {
     vocab_["<unk>"] = 0;
@@ -144,6 +218,11 @@ const std::unordered_map<std::string, TokenId>& BPETokenizer::GetVocabulary() co
     return vocab_;
 }
 
+bool BPETokenizer::IsTokenBoundary(const std::string& text, size_t pos) const {
+    // Слияния применяются внутри слова, поэтому граница слова - граница токена
+    return IsWordBoundary(text, pos);
+}
+
 bool BPETokenizer::SaveVocabulary(const std::string& file_path) const {
     std::ofstream file(file_path);
     if (!file) {
@@ -393,6 +472,18 @@ const std::unordered_map<std::string, TokenId>& CharacterTokenizer::GetVocabular
     return vocab_;
 }
 
+bool CharacterTokenizer::IsTokenBoundary(const std::string& text, size_t pos) const {
+    return IsCharBoundary(text, pos);
+}
+
+size_t CharacterTokenizer::CountTokens(std::string_view text) const {
+    return CountUtf8Chars(text);
+}
+
+bool CharacterTokenizer::HasFastTokenCount() const {
+    return true;
+}
+
 bool CharacterTokenizer::SaveVocabulary(const std::string& file_path) const {
     std::ofstream file(file_path);
     if (!file) {
@@ -485,6 +576,18 @@ const std::unordered_map<std::string, TokenId>& WordTokenizer::GetVocabulary() c
     return vocab_;
 }
 
+bool WordTokenizer::IsTokenBoundary(const std::string& text, size_t pos) const {
+    return IsWordBoundary(text, pos);
+}
+
+size_t WordTokenizer::CountTokens(std::string_view text) const {
+    return CountWords(text);
+}
+
+bool WordTokenizer::HasFastTokenCount() const {
+    return true;
+}
+
 bool WordTokenizer::SaveVocabulary(const std::string& file_path) const {
     std::ofstream file(file_path);
     if (!file) {
@@ -579,6 +682,34 @@ const std::unordered_map<std::string, TokenId>& WhitespaceTokenizer::GetVocabula
     return vocab_;
 }
 
+bool WhitespaceTokenizer::IsTokenBoundary(const std::string& text, size_t pos) const {
+    if (pos == 0 || pos == text.length()) {
+        return true;
+    }
+    
+    return std::isspace(static_cast<unsigned char>(text[pos - 1])) ||
+           std::isspace(static_cast<unsigned char>(text[pos]));
+}
+
+size_t WhitespaceTokenizer::CountTokens(std::string_view text) const {
+    size_t count = 0;
+    bool in_token = false;
+    
+    for (char c : text) {
+        bool is_space = std::isspace(static_cast<unsigned char>(c));
+        if (!is_space && !in_token) {
+            ++count;
+        }
+        in_token = !is_space;
+    }
+    
+    return count;
+}
+
+bool WhitespaceTokenizer::HasFastTokenCount() const {
+    return true;
+}
+
 bool WhitespaceTokenizer::SaveVocabulary(const std::string& file_path) const {
     std::ofstream file(file_path);
     if (!file) {
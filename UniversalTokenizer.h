@@ -49,11 +49,26 @@ public:
     virtual bool SaveVocabulary(const std::string& file_path) const = 0;
     virtual bool LoadVocabulary(const std::string& file_path) = 0;
 
+    // Можно ли разрезать text в позиции pos так, чтобы токены обеих частей
+    // совпали с токенами целого текста
+    virtual bool IsTokenBoundary(const std::string& text, size_t pos) const;
+    // Число токенов, которое вернет Encode(text)
+    virtual size_t CountTokens(std::string_view text) const;
+    // CountTokens проходит байты, не токенизируя: без этого отрезать общие
+    // байты текстов невыгодно, их все равно пришлось бы токенизировать
+    virtual bool HasFastTokenCount() const;
+
 protected:
     std::vector<std::string> SplitIntoUtf8Chars(const std::string& text) const;
     std::vector<std::string> SplitIntoWords(const std::string& text) const;
     
     bool IsUtf8Char(char c) const;
+    size_t GetUtf8CharLength(char c) const;
+
+    bool IsCharBoundary(const std::string& text, size_t pos) const;
+    bool IsWordBoundary(const std::string& text, size_t pos) const;
+    size_t CountUtf8Chars(std::string_view text) const;
+    size_t CountWords(std::string_view text) const;
     
     UniversalParserMode parser_mode_;
 };
@@ -70,6 +85,8 @@ public:
     bool SaveVocabulary(const std::string& file_path) const override;
     bool LoadVocabulary(const std::string& file_path) override;
     
+    bool IsTokenBoundary(const std::string& text, size_t pos) const override;
+    
     void Train(const std::vector<std::string>& corpus, int vocab_size, int min_frequency = 2);
     void AddMerges(const std::vector<std::pair<std::string, std::string>>& merges);
     
@@ -93,6 +110,10 @@ public:
     
     bool SaveVocabulary(const std::string& file_path) const override;
     bool LoadVocabulary(const std::string& file_path) override;
+
+    bool IsTokenBoundary(const std::string& text, size_t pos) const override;
+    size_t CountTokens(std::string_view text) const override;
+    bool HasFastTokenCount() const override;
     
 private:
     std::unordered_map<std::string, TokenId> vocab_;
@@ -110,6 +131,10 @@ public:
     
     bool SaveVocabulary(const std::string& file_path) const override;
     bool LoadVocabulary(const std::string& file_path) override;
+
+    bool IsTokenBoundary(const std::string& text, size_t pos) const override;
+    size_t CountTokens(std::string_view text) const override;
+    bool HasFastTokenCount() const override;
     
 private:
     std::unordered_map<std::string, TokenId> vocab_;
@@ -127,6 +152,10 @@ public:
     
     bool SaveVocabulary(const std::string& file_path) const override;
     bool LoadVocabulary(const std::string& file_path) override;
+
+    bool IsTokenBoundary(const std::string& text, size_t pos) const override;
+    size_t CountTokens(std::string_view text) const override;
+    bool HasFastTokenCount() const override;
     
 private:
     std::unordered_map<std::string, TokenId> vocab_;
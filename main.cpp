@@ -1,5 +1,6 @@
 #include "UniversalTokenizer.h"
 #include "MyersDiff.h"
+#include "StreamingDiff.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -22,11 +23,27 @@ int main(int argc, char* argv[]) {
     std::string oldFileName = "old.txt";
     std::string newFileName = "new.txt";
     
+    // Файлы больше памяти сравниваются по окнам, diff выводится по ходу чтения
+    if (argc > 3 && std::string(argv[1]) == "--stream") {
+        std::ifstream oldFile(argv[2]);
+        std::ifstream newFile(argv[3]);
+        if (!oldFile.is_open() || !newFile.is_open()) {
+            std::cerr << "Ошибка: не удалось открыть файлы " << argv[2] << " и " << argv[3] << std::endl;
+            return 1;
+        }
+        
+        StreamingDiff diff(UniversalTokenizerMode::WORD);
+        if (diff.Run(oldFile, newFile, std::cout)) {
+            std::cout << "Тексты идентичны" << std::endl;
+        }
+        return 0;
+    }
+    
     if (argc > 2) {
         oldFileName = argv[1];
         newFileName = argv[2];
     } else if (argc > 1) {
-        std::cout << "Использование: " << argv[0] << " old.txt new.txt" << std::endl;
+        std::cout << "Использование: " << argv[0] << " [--stream] old.txt new.txt" << std::endl;
         std::cout << "Используем файлы по умолчанию: " << oldFileName << " и " << newFileName << std::endl;
     }
     
@@ -3,9 +3,50 @@
 
 #include "UniversalTokenizer.h"
 #include "MyersDiff.h"
+#include "TokenMatch.h"
+#include "ThreadPool.h"
+#include "BitParallelLcs.h"
+#include "StreamingDiff.h"
 #include <memory>
 #include <string>
 #include <vector>
+#include <thread>
+#include <functional>
+#include <utility>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <cstdio>
+
+// Пара текстов из count слов word(i) (каждое заканчивается пробелом): в первом
+// после каждого 11-го слова лишний токен removed, во втором перед каждым 13-м
+// вставлен inserted. Правки из слов общего словаря переживают отбрасывание
+// токенов, которых нет в другом тексте, и не вырождают окно в D = 0.
+static std::pair<std::string, std::string> MakeEditedTexts(int count, const std::function<std::string(int)>& word,
+                                                           const std::string& removed,
+                                                           const std::string& inserted) {
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < count; ++i) {
+        text1 += word(i) + (i % 11 == 0 ? removed : "");
+        text2 += (i % 13 == 0 ? inserted : "") + word(i);
+    }
+    return {text1, text2};
+}
+
+// Файл с уникальным именем во временном каталоге, удаляется и при упавшем REQUIRE
+struct TemporaryFile {
+    explicit TemporaryFile(const std::string& name)
+        : path(std::filesystem::temp_directory_path() /
+               (name + "_" + std::to_string(std::random_device()()) + ".txt")) {
+    }
+    ~TemporaryFile() {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+
+    std::filesystem::path path;
+};
 
 TEST_CASE("Character Tokenizer tests", "[tokenizer][character]") {
     auto tokenizer = CreateTokenizer(UniversalTokenizerMode::CHARACTER);
@@ -84,6 +125,93 @@ TEST_CASE("Whitespace Tokenizer tests", "[tokenizer][whitespace]") {
     }
 }
 
+TEST_CASE("Tokenizer boundaries and counting", "[tokenizer][boundary]") {
+    std::string text = "привет, мир\nhello  world\tend";
+
+    SECTION("Token count matches encoding") {
+        for (auto mode : {UniversalTokenizerMode::CHARACTER, UniversalTokenizerMode::WORD,
+                          UniversalTokenizerMode::WHITESPACE, UniversalTokenizerMode::BPE}) {
+            auto tokenizer = CreateTokenizer(mode);
+            REQUIRE(tokenizer->CountTokens(text) == tokenizer->Encode(text).size());
+            // BPE считает токены через Encode, и отрезать общие байты ему невыгодно
+            REQUIRE(tokenizer->HasFastTokenCount() == (mode != UniversalTokenizerMode::BPE));
+        }
+    }
+
+    SECTION("Word boundaries are next to whitespace") {
+        auto tokenizer = CreateTokenizer(UniversalTokenizerMode::WORD);
+        std::string ascii = "abc def";
+
+        REQUIRE(tokenizer->IsTokenBoundary(ascii, 0));
+        REQUIRE(tokenizer->IsTokenBoundary(ascii, 3));
+        REQUIRE(tokenizer->IsTokenBoundary(ascii, 4));
+        REQUIRE_FALSE(tokenizer->IsTokenBoundary(ascii, 2));
+        REQUIRE(tokenizer->IsTokenBoundary(ascii, ascii.size()));
+    }
+
+    SECTION("Character boundaries never split a UTF-8 sequence") {
+        auto tokenizer = CreateTokenizer(UniversalTokenizerMode::CHARACTER);
+        std::string mixed = "abcжdef";
+
+        REQUIRE(tokenizer->IsTokenBoundary(mixed, 3));
+        REQUIRE_FALSE(tokenizer->IsTokenBoundary(mixed, 4));
+        REQUIRE_FALSE(tokenizer->IsTokenBoundary(mixed, 5));
+        REQUIRE(tokenizer->IsTokenBoundary(mixed, 8));
+    }
+}
+
+template <typename Symbol>
+static void RequireMatchKernels() {
+    std::vector<Symbol> from(100);
+    for (size_t i = 0; i < from.size(); ++i) {
+        from[i] = static_cast<Symbol>(i * 7 + 1);
+    }
+
+    // Несовпадение в каждой позиции, чтобы задеть и векторные блоки, и хвост
+    for (size_t mismatch = 0; mismatch <= from.size(); ++mismatch) {
+        std::vector<Symbol> to = from;
+        if (mismatch < to.size()) {
+            ++to[mismatch];
+        }
+
+        REQUIRE(CommonPrefixLength(from.data(), to.data(), from.size()) == mismatch);
+        REQUIRE(CommonPrefixLength(from.data(), to.data(), mismatch / 2) == mismatch / 2);
+
+        size_t suffix = mismatch < to.size() ? to.size() - mismatch - 1 : to.size();
+        REQUIRE(CommonSuffixLength(from.data() + from.size(), to.data() + to.size(), from.size()) == suffix);
+        REQUIRE(CommonSuffixLength(from.data() + from.size(), to.data() + to.size(), suffix / 3) == suffix / 3);
+    }
+}
+
+TEST_CASE("Token match kernels", "[match]") {
+    SECTION("Dictionary token ids") {
+        RequireMatchKernels<TokenId>();
+    }
+
+    SECTION("Dense 8 and 16-bit ids") {
+        RequireMatchKernels<uint8_t>();
+        RequireMatchKernels<uint16_t>();
+    }
+}
+
+TEST_CASE("Match bitmaps", "[diff][bitmap]") {
+    MatchBitmap matched(200);
+    matched.MarkRange(3, 3);
+    matched.MarkRange(60, 140);
+    matched.Mark(199);
+
+    REQUIRE(matched.FindMatched(0, 200) == 60);
+    REQUIRE(matched.FindMatched(0, 50) == 50);
+    REQUIRE(matched.FindUnmatched(60, 200) == 140);
+    REQUIRE(matched.FindUnmatched(60, 100) == 100);
+    REQUIRE(matched.FindMatched(140, 200) == 199);
+    REQUIRE(matched.FindUnmatched(199, 200) == 200);
+    REQUIRE(matched.FindUnmatched(0, 200) == 0);
+
+    MatchBitmap empty(130);
+    REQUIRE(empty.FindMatched(0, 130) == 130);
+}
+
 TEST_CASE("Myers Diff tests", "[diff]") {
     SECTION("Identical texts") {
         std::string text1 = "This is a test";
@@ -183,6 +311,707 @@ TEST_CASE("Myers Diff tests", "[diff]") {
     }
 }
 
+TEST_CASE("Myers workspace reuse", "[diff][workspace]") {
+    std::vector<std::pair<std::string, std::string>> pairs = {
+        {"a b c d e f g h i j k l m n", "a x c d y f g h z j k l q n r"},
+        {"one two", "two three"},
+        {"The quick brown fox jumps over the lazy dog", "A fast brown fox jumps above the sleepy dog"},
+        {"x", "y y y y y y y y y y y y y y y y y y y y y y y y"}
+    };
+
+    // Сотни шагов поиска: память под диагонали растет по ходу поиска
+    std::string long_from;
+    std::string long_to;
+    for (int i = 0; i < 600; ++i) {
+        long_from += "w" + std::to_string(i * 7 % 5) + " ";
+        long_to += "w" + std::to_string(i * 3 % 4) + (i % 2 ? " " : " w9 ");
+    }
+    pairs.emplace_back(long_from, long_to);
+
+    MyersWorkspace workspace;
+    MyersDiffOptions options;
+    options.workspace = &workspace;
+
+    // Переиспользуем одну рабочую память для задач разного размера
+    for (int round = 0; round < 2; ++round) {
+        for (const auto& [text1, text2] : pairs) {
+            MyersDiff shared(CreateTokenizer(UniversalTokenizerMode::WORD), text1, text2, options);
+            MyersDiff fresh(CreateTokenizer(UniversalTokenizerMode::WORD), text1, text2);
+
+            REQUIRE(shared.GetLevenshteinDistance() == fresh.GetLevenshteinDistance());
+            REQUIRE(shared.GetDiff(DiffFormat::NORMAL) == fresh.GetDiff(DiffFormat::NORMAL));
+        }
+    }
+
+    SECTION("Concurrent const readers") {
+        // Расчет, не захвативший общую память, считает в своей
+        MyersDiff shared(CreateTokenizer(UniversalTokenizerMode::WORD), long_from, long_to, options);
+        int expected = MyersDiff(CreateTokenizer(UniversalTokenizerMode::WORD), long_from, long_to)
+                           .ComputeEditDistance();
+
+        std::vector<std::thread> readers;
+        std::vector<int> distances(4);
+        std::vector<int> bounded(4);
+        for (size_t i = 0; i < distances.size(); ++i) {
+            readers.emplace_back([&, i] {
+                for (int repeat = 0; repeat < 20; ++repeat) {
+                    distances[i] = shared.ComputeEditDistance();
+                    bounded[i] = shared.WithinDistance(expected).value_or(-1);
+                }
+            });
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        for (size_t i = 0; i < distances.size(); ++i) {
+            REQUIRE(distances[i] == expected);
+            REQUIRE(bounded[i] == expected);
+        }
+        REQUIRE(workspace.TryAcquire());
+        workspace.Release();
+    }
+}
+
+TEST_CASE("Edit script is shared between formats and metrics", "[diff][cache]") {
+    std::string text1 = "The quick brown fox jumps over the lazy dog";
+    std::string text2 = "A fast brown fox jumps above the sleepy dog";
+
+    MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WORD), text1, text2);
+
+    std::vector<std::thread> readers;
+    std::vector<int> distances(4);
+    std::vector<std::string> diffs(4);
+    for (size_t i = 0; i < distances.size(); ++i) {
+        readers.emplace_back([&, i] {
+            distances[i] = diff.GetLevenshteinDistance();
+            diffs[i] = diff.GetDiff(DiffFormat::UNIFIED);
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    for (size_t i = 0; i < distances.size(); ++i) {
+        REQUIRE(distances[i] == 8);
+        REQUIRE(diffs[i] == diffs[0]);
+    }
+
+    auto script = diff.GetShortestEditScript();
+    auto lcs = diff.GetLargestCommonSubsequence();
+    uint32_t replaced = 0;
+    for (const auto& rep : script) {
+        replaced += rep.from_right - rep.from_left;
+    }
+    REQUIRE(lcs.size() + replaced == 17);
+}
+
+TEST_CASE("Common prefix and suffix trimming", "[diff][trim]") {
+    std::string head;
+    std::string tail;
+    for (int i = 0; i < 100; ++i) {
+        head += "head" + std::to_string(i) + "\n";
+        tail += "tail" + std::to_string(i) + "\n";
+    }
+
+    SECTION("Replacement positions are relative to the whole text") {
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WORD),
+                       head + "old\n" + tail, head + "new\n" + tail);
+        auto script = diff.GetShortestEditScript();
+
+        REQUIRE(script.size() == 1);
+        REQUIRE(script[0].from_left == 200);
+        REQUIRE(script[0].from_right == 201);
+        REQUIRE(script[0].to_left == 200);
+        REQUIRE(script[0].to_right == 201);
+        REQUIRE(diff.GetLargestCommonSubsequence().size() == 401);
+    }
+
+    SECTION("Pure insertion between common parts") {
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WORD), head + tail,
+                       head + "inserted\n" + tail);
+        auto script = diff.GetShortestEditScript();
+
+        REQUIRE(script.size() == 1);
+        REQUIRE(script[0].from_left == script[0].from_right);
+        REQUIRE(script[0].to_right - script[0].to_left == 2);
+        REQUIRE(diff.GetLevenshteinDistance() == 2);
+    }
+}
+
+TEST_CASE("Byte-level skip of common text", "[diff][skip]") {
+    std::string head;
+    std::string tail;
+    for (int i = 0; i < 200; ++i) {
+        head += "строка " + std::to_string(i) + "\n";
+        tail += "line " + std::to_string(i) + "\n";
+    }
+    std::string text1 = head + "старый текст\n" + tail;
+    std::string text2 = head + "новый текст\n" + tail;
+
+    for (auto mode : {UniversalTokenizerMode::CHARACTER, UniversalTokenizerMode::WORD,
+                      UniversalTokenizerMode::WHITESPACE}) {
+        MyersDiffOptions full_options;
+        full_options.skip_common_bytes = false;
+
+        MyersDiff skipped(CreateTokenizer(mode), text1, text2);
+        MyersDiff full(CreateTokenizer(mode), text1, text2, full_options);
+
+        auto skipped_script = skipped.GetShortestEditScript();
+        auto full_script = full.GetShortestEditScript();
+        REQUIRE(skipped_script.size() == full_script.size());
+        for (size_t i = 0; i < full_script.size(); ++i) {
+            REQUIRE(skipped_script[i].from_left == full_script[i].from_left);
+            REQUIRE(skipped_script[i].from_right == full_script[i].from_right);
+            REQUIRE(skipped_script[i].to_left == full_script[i].to_left);
+            REQUIRE(skipped_script[i].to_right == full_script[i].to_right);
+        }
+
+        // Контекст шире запаса токенизации читает отрезанные части
+        REQUIRE(skipped.GetDiff(DiffFormat::UNIFIED, 100) == full.GetDiff(DiffFormat::UNIFIED, 100));
+        REQUIRE(skipped.GetDiff(DiffFormat::CONTEXT) == full.GetDiff(DiffFormat::CONTEXT));
+        REQUIRE(skipped.GetLargestCommonSubsequence().size() ==
+                full.GetLargestCommonSubsequence().size());
+        REQUIRE_FALSE(skipped.AreTextsIdentical());
+    }
+
+    SECTION("Skipped parts do not refer to the input") {
+        MyersDiffOptions full_options;
+        full_options.skip_common_bytes = false;
+        MyersDiff full(CreateTokenizer(UniversalTokenizerMode::WORD), text1, text2, full_options);
+
+        std::unique_ptr<MyersDiff> skipped;
+        {
+            std::string from = text1;
+            skipped = std::make_unique<MyersDiff>(CreateTokenizer(UniversalTokenizerMode::WORD), from, text2);
+        }
+        REQUIRE(skipped->GetDiff(DiffFormat::UNIFIED, 100) == full.GetDiff(DiffFormat::UNIFIED, 100));
+        REQUIRE(skipped->GetLargestCommonSubsequence().size() == full.GetLargestCommonSubsequence().size());
+    }
+
+    SECTION("Identical texts are not tokenized") {
+        MyersDiff identical(CreateTokenizer(UniversalTokenizerMode::WORD), text1, text1);
+        REQUIRE(identical.AreTextsIdentical());
+        REQUIRE(identical.GetShortestEditScript().empty());
+        REQUIRE(identical.GetDiff().empty());
+        REQUIRE(identical.GetLevenshteinDistance() == 0);
+        REQUIRE(identical.ComputeEditDistance() == 0);
+        REQUIRE(identical.GetLargestCommonSubsequence() ==
+                CreateTokenizer(UniversalTokenizerMode::WORD)->Encode(text1));
+    }
+
+    SECTION("Identical temporaries") {
+        MyersDiff identical(CreateTokenizer(UniversalTokenizerMode::WORD), std::string(text1), text1);
+        REQUIRE(identical.AreTextsIdentical());
+        REQUIRE(identical.GetLargestCommonSubsequence() ==
+                CreateTokenizer(UniversalTokenizerMode::WORD)->Encode(text1));
+    }
+}
+
+TEST_CASE("Many alternating edits", "[diff][deep]") {
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 3000; ++i) {
+        text1 += "same" + std::to_string(i) + " old" + std::to_string(i) + " ";
+        text2 += "same" + std::to_string(i) + " new" + std::to_string(i) + " ";
+    }
+
+    MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+
+    REQUIRE(diff.GetLevenshteinDistance() == 6000);
+    REQUIRE(diff.GetShortestEditScript().size() == 3000);
+}
+
+// Вне замен токены текстов совпадают попарно (тексты разбиваются по пробелам)
+static void RequireValidScript(const MyersDiff& diff, const std::string& text1, const std::string& text2) {
+    auto tokenizer = CreateTokenizer(UniversalTokenizerMode::WHITESPACE);
+    auto from_tokens = tokenizer->Encode(text1);
+    auto to_tokens = tokenizer->Encode(text2);
+    uint32_t from_id = 0;
+    uint32_t to_id = 0;
+    for (const auto& replacement : diff.GetShortestEditScript()) {
+        REQUIRE(replacement.from_left - from_id == replacement.to_left - to_id);
+        for (; from_id < replacement.from_left; ++from_id, ++to_id) {
+            REQUIRE(from_tokens[from_id] == to_tokens[to_id]);
+        }
+        from_id = replacement.from_right;
+        to_id = replacement.to_right;
+    }
+    REQUIRE(from_tokens.size() - from_id == to_tokens.size() - to_id);
+}
+
+TEST_CASE("Streaming edit script", "[diff][sink]") {
+    auto [text1, text2] = MakeEditedTexts(2000, [](int i) { return "w" + std::to_string(i % 37) + " "; },
+                                          "w3 ", "w5 ");
+
+    for (bool discard_unmatched : {true, false}) {
+        MyersDiffOptions options;
+        options.discard_unmatched = discard_unmatched;
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+
+        EditScript streamed;
+        diff.StreamShortestEditScript([&](const Replacement& replacement) {
+            // Замены приходят по порядку и не пересекаются
+            if (!streamed.empty()) {
+                REQUIRE(replacement.from_left >= streamed.back().from_right);
+                REQUIRE(replacement.to_left >= streamed.back().to_right);
+            }
+            streamed.push_back(replacement);
+        });
+
+        auto script = diff.GetShortestEditScript();
+        REQUIRE(streamed.size() == script.size());
+        for (size_t i = 0; i < script.size(); ++i) {
+            REQUIRE(streamed[i].from_left == script[i].from_left);
+            REQUIRE(streamed[i].from_right == script[i].from_right);
+            REQUIRE(streamed[i].to_left == script[i].to_left);
+            REQUIRE(streamed[i].to_right == script[i].to_right);
+        }
+    }
+}
+
+TEST_CASE("Parallel snake decomposition", "[diff][parallel]") {
+    auto [text1, text2] = MakeEditedTexts(2000, [](int i) { return "w" + std::to_string(i % 37) + " "; },
+                                          "w3 ", "w5 ");
+
+    // Декомпозиция идет по полным окнам, без отбрасывания токенов и без
+    // прямого прохода со следом, который решил бы окно целиком сам
+    MyersDiffOptions serial_options;
+    serial_options.discard_unmatched = false;
+    serial_options.greedy_trace_bytes = 0;
+    MyersDiff serial(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, serial_options);
+    REQUIRE(serial.GetLevenshteinDistance() > 0);
+    auto serial_script = serial.GetShortestEditScript();
+
+    auto require_same_script = [&](const MyersDiff& diff) {
+        auto script = diff.GetShortestEditScript();
+        REQUIRE(script.size() == serial_script.size());
+        for (size_t i = 0; i < serial_script.size(); ++i) {
+            REQUIRE(script[i].from_left == serial_script[i].from_left);
+            REQUIRE(script[i].to_left == serial_script[i].to_left);
+            REQUIRE(script[i].from_right == serial_script[i].from_right);
+            REQUIRE(script[i].to_right == serial_script[i].to_right);
+        }
+        REQUIRE(diff.GetLevenshteinDistance() == serial.GetLevenshteinDistance());
+    };
+
+    SECTION("Subproblems on a thread pool") {
+        ThreadPool pool(4);
+        MyersDiffStats stats;
+        MyersDiffOptions options = serial_options;
+        options.thread_pool = &pool;
+        options.parallel_cutoff = 64;
+        options.stats = &stats;
+
+        require_same_script(MyersDiff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE),
+                                      text1, text2, options));
+        REQUIRE(stats.forked_tasks > 0);
+    }
+
+    SECTION("Forward and reverse sweeps in two threads") {
+        MyersDiffStats stats;
+        MyersDiffOptions options = serial_options;
+        options.concurrent_sweeps = true;
+        options.concurrent_sweeps_cutoff = 16;
+        options.stats = &stats;
+
+        require_same_script(MyersDiff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE),
+                                      text1, text2, options));
+        REQUIRE(stats.concurrent_sweeps > 0);
+    }
+
+    SECTION("Independent chunks between unique anchors") {
+        auto [anchored1, anchored2] = MakeEditedTexts(
+            2000, [](int i) { return "u" + std::to_string(i) + " w" + std::to_string(i % 37) + " "; },
+            "w3 ", "w5 ");
+
+        ThreadPool pool(4);
+        MyersDiffStats stats;
+        MyersDiffOptions options = serial_options;
+        options.thread_pool = &pool;
+        options.parallel_cutoff = 64;
+        options.chunk_by_anchors = true;
+        options.stats = &stats;
+        MyersDiff chunked(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), anchored1, anchored2, options);
+        MyersDiff whole(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), anchored1, anchored2);
+
+        RequireValidScript(chunked, anchored1, anchored2);
+        REQUIRE(chunked.GetLevenshteinDistance() == whole.GetLevenshteinDistance());
+        REQUIRE(stats.forked_tasks > 0);
+    }
+}
+
+TEST_CASE("Small subproblem base case", "[diff][base]") {
+    // Частые правки дробят окно на подзадачи в несколько токенов,
+    // которые решаются таблицей LCS
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 1500; ++i) {
+        text1 += "t" + std::to_string(i * 5 % 7) + " ";
+        text2 += "t" + std::to_string(i * 3 % 8) + " ";
+    }
+
+    MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+    RequireValidScript(diff, text1, text2);
+    REQUIRE(diff.GetLevenshteinDistance() == diff.ComputeEditDistance());
+}
+
+TEST_CASE("Forward greedy engine", "[diff][greedy]") {
+    // Десяток правок на тысячи токенов: D мало, и скрипт ищется одним проходом
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 4000; ++i) {
+        std::string word = "w" + std::to_string(i % 97);
+        text1 += word + (i % 401 == 0 ? " old " : " ");
+        text2 += (i % 367 == 0 ? "new " : "") + word + " ";
+    }
+
+    MyersDiffOptions divide_options;
+    divide_options.greedy_trace_bytes = 0;
+    MyersDiff divide(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, divide_options);
+
+    SECTION("Single pass with a trace") {
+        MyersDiff greedy(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        RequireValidScript(greedy, text1, text2);
+        REQUIRE(greedy.GetLevenshteinDistance() == divide.GetLevenshteinDistance());
+    }
+
+    SECTION("Fallback when the trace does not fit") {
+        MyersDiffOptions options;
+        options.greedy_trace_bytes = 64;
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+        RequireValidScript(diff, text1, text2);
+        REQUIRE(diff.GetLevenshteinDistance() == divide.GetLevenshteinDistance());
+    }
+}
+
+TEST_CASE("Unbalanced window engine", "[diff][unbalanced]") {
+    // Короткий шаблон против длинного вывода: D не меньше разности длин,
+    // а удалений из шаблона немного
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 300; ++i) {
+        std::string word = "w" + std::to_string(i % 23);
+        text1 += word + " ";
+        if (i % 37 != 0) {
+            text2 += word + " ";
+        }
+        for (int j = 0; j < 9; ++j) {
+            text2 += "w" + std::to_string((i * 5 + j * 3) % 23) + " ";
+        }
+    }
+
+    MyersDiffOptions divide_options;
+    divide_options.greedy_trace_bytes = 0;
+
+    SECTION("Short side first") {
+        MyersDiff unbalanced(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        MyersDiff divide(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, divide_options);
+        RequireValidScript(unbalanced, text1, text2);
+        REQUIRE(unbalanced.GetLevenshteinDistance() == divide.GetLevenshteinDistance());
+    }
+
+    SECTION("Long side first") {
+        MyersDiff unbalanced(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text2, text1);
+        MyersDiff divide(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text2, text1, divide_options);
+        RequireValidScript(unbalanced, text2, text1);
+        REQUIRE(unbalanced.GetLevenshteinDistance() == divide.GetLevenshteinDistance());
+    }
+}
+
+TEST_CASE("Dense token remapping", "[diff][dense]") {
+    // Окна в тысячи токенов перекодируются в 8- или 16-битные номера
+    // в зависимости от числа разных токенов
+    for (int vocabulary : {37, 1000}) {
+        auto [text1, text2] = MakeEditedTexts(
+            3000, [&](int i) { return "w" + std::to_string(i * 7 % vocabulary) + " "; }, "w3 ", "w5 ");
+
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        RequireValidScript(diff, text1, text2);
+        REQUIRE(diff.GetLevenshteinDistance() == diff.ComputeEditDistance());
+    }
+}
+
+TEST_CASE("Sparse vocabulary ids", "[diff][dense]") {
+    // Словарь из файла с номерами около 4 * 10^9: таблицы по номеру токена
+    // заняли бы гигабайты на каждое окно
+    TemporaryFile vocabulary_file("sparse_vocab");
+    {
+        std::ofstream vocabulary(vocabulary_file.path);
+        for (uint32_t word = 0; word < 37; ++word) {
+            vocabulary << "w" << word << "\t" << 4000000000u - word * 100000007u << "\n";
+        }
+    }
+    auto tokenizer = CreateTokenizer(UniversalTokenizerMode::WHITESPACE);
+    REQUIRE(tokenizer->LoadVocabulary(vocabulary_file.path.string()));
+
+    // Во втором тексте есть слова вне словаря, и отбрасывание сжимает окно
+    auto [text1, text2] = MakeEditedTexts(3000, [](int i) { return "w" + std::to_string(i * 7 % 37) + " "; },
+                                          "w3 ", "new ");
+    MyersDiff sparse(std::move(tokenizer), text1, text2);
+    MyersDiff dense(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+
+    RequireValidScript(sparse, text1, text2);
+    REQUIRE(sparse.GetLevenshteinDistance() == dense.GetLevenshteinDistance());
+}
+
+TEST_CASE("Cost-bounded heuristic", "[diff][heuristic]") {
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 600; ++i) {
+        text1 += "a" + std::to_string(i * 7 % 101) + " ";
+        text2 += "a" + std::to_string(i * 11 % 103) + " ";
+    }
+
+    MyersDiff exact(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+
+    MyersDiffOptions options;
+    options.max_cost = 8;
+    MyersDiff bounded(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+
+    // Скрипт может быть длиннее минимального, но должен оставаться корректным
+    RequireValidScript(bounded, text1, text2);
+    REQUIRE(bounded.GetLevenshteinDistance() >= exact.GetLevenshteinDistance());
+
+    SECTION("Minimal output overrides the bound") {
+        options.minimal = true;
+        MyersDiff minimal(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+        REQUIRE(minimal.GetLevenshteinDistance() == exact.GetLevenshteinDistance());
+    }
+}
+
+TEST_CASE("Patience diff", "[diff][patience]") {
+    MyersDiffOptions options;
+    options.algorithm = DiffAlgorithm::PATIENCE;
+
+    SECTION("Alignment on the unique token") {
+        // Майерс сохранил бы два повторяющихся токена, patience - единственный уникальный
+        std::string text1 = "x x x u y y";
+        std::string text2 = "y y u x x x";
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+
+        RequireValidScript(diff, text1, text2);
+        REQUIRE(diff.GetLargestCommonSubsequence().size() == 1);
+        REQUIRE(diff.GetLevenshteinDistance() == 10);
+    }
+
+    SECTION("Same result as Myers on small edits") {
+        std::string text1;
+        std::string text2;
+        for (int i = 0; i < 500; ++i) {
+            text1 += "line" + std::to_string(i) + " { } ";
+            text2 += (i % 50 == 0 ? "added { } " : "") + ("line" + std::to_string(i)) + " { } ";
+        }
+
+        MyersDiff myers(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        MyersDiff patience(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+
+        RequireValidScript(patience, text1, text2);
+        REQUIRE(patience.GetLevenshteinDistance() == myers.GetLevenshteinDistance());
+    }
+}
+
+TEST_CASE("Histogram diff", "[diff][histogram]") {
+    std::string text1 = "x x x u y y";
+    std::string text2 = "y y u x x x";
+    MyersDiffOptions options;
+    options.algorithm = DiffAlgorithm::HISTOGRAM;
+
+    SECTION("Split on the rarest common region") {
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+
+        RequireValidScript(diff, text1, text2);
+        REQUIRE(diff.GetLargestCommonSubsequence().size() == 1);
+    }
+
+    SECTION("Myers fallback over the chain limit") {
+        options.max_chain_length = 0;
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+        MyersDiff myers(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+
+        RequireValidScript(diff, text1, text2);
+        REQUIRE(diff.GetLevenshteinDistance() == myers.GetLevenshteinDistance());
+    }
+}
+
+TEST_CASE("Bit-parallel LCS", "[diff][bitparallel]") {
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 700; ++i) {
+        text1 += static_cast<char>('a' + i * 7 % 13);
+        text2 += static_cast<char>('a' + i * 5 % 11);
+    }
+
+    SECTION("Length over several machine words") {
+        std::vector<TokenId> from(text1.begin(), text1.end());
+        std::vector<TokenId> to(text2.begin(), text2.end());
+
+        std::vector<std::vector<uint32_t>> lcs(from.size() + 1, std::vector<uint32_t>(to.size() + 1));
+        for (size_t i = 1; i <= from.size(); ++i) {
+            for (size_t j = 1; j <= to.size(); ++j) {
+                lcs[i][j] = from[i - 1] == to[j - 1] ? lcs[i - 1][j - 1] + 1
+                                                     : std::max(lcs[i - 1][j], lcs[i][j - 1]);
+            }
+        }
+
+        REQUIRE(GetBitParallelLcsLength(from.data(), from.size(), to.data(), to.size(), 256) ==
+                lcs[from.size()][to.size()]);
+        REQUIRE_FALSE(GetBitParallelLcsLength(from.data(), from.size(), to.data(), to.size(), 8));
+    }
+
+    SECTION("Minimal script, chosen explicitly and automatically") {
+        MyersDiff myers(CreateTokenizer(UniversalTokenizerMode::CHARACTER), text1, text2);
+
+        MyersDiffOptions options;
+        options.algorithm = DiffAlgorithm::BIT_PARALLEL;
+        MyersDiff explicit_diff(CreateTokenizer(UniversalTokenizerMode::CHARACTER), text1, text2, options);
+        REQUIRE(explicit_diff.GetLevenshteinDistance() == myers.GetLevenshteinDistance());
+
+        MyersDiffOptions automatic;
+        automatic.bit_parallel_cutoff = 64;
+        MyersDiff automatic_diff(CreateTokenizer(UniversalTokenizerMode::CHARACTER), text1, text2, automatic);
+        REQUIRE(automatic_diff.GetLevenshteinDistance() == myers.GetLevenshteinDistance());
+        REQUIRE(automatic_diff.GetLargestCommonSubsequence().size() ==
+                myers.GetLargestCommonSubsequence().size());
+    }
+}
+
+TEST_CASE("Discarding unmatched tokens", "[diff][discard]") {
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 300; ++i) {
+        text1 += "k" + std::to_string(i % 17) + (i % 3 == 0 ? " old" + std::to_string(i) + " " : " ");
+        text2 += (i % 4 == 0 ? "new" + std::to_string(i) + " " : "") + "k" + std::to_string(i % 19) + " ";
+    }
+
+    MyersDiffOptions options;
+    options.discard_unmatched = false;
+    MyersDiff full(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+    MyersDiff discarded(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+
+    RequireValidScript(discarded, text1, text2);
+    REQUIRE(discarded.GetLevenshteinDistance() == full.GetLevenshteinDistance());
+}
+
+TEST_CASE("Streaming diff", "[diff][streaming]") {
+    // Строки с + и - в ханках: по токену на строку, как у GetUnifiedHunks
+    auto count_changes = [](const std::string& diff, int& distance, int& hunks_count) {
+        std::istringstream hunks(diff);
+        std::string line;
+        distance = 0;
+        hunks_count = 0;
+        while (std::getline(hunks, line)) {
+            if (line.rfind("@@", 0) == 0) {
+                ++hunks_count;
+            } else if (hunks_count > 0 && (line[0] == '-' || line[0] == '+')) {
+                ++distance;
+            }
+        }
+    };
+
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 300; ++i) {
+        std::string line = "line" + std::to_string(i) + " of text\n";
+        text1 += line;
+        text2 += (i % 40 == 7 ? "inserted line\n" : "") + (i % 55 == 3 ? "changed line\n" : line);
+    }
+
+    StreamingDiffOptions options;
+    options.window_bytes = 512;
+    StreamingDiff streaming(UniversalTokenizerMode::WORD, options);
+    std::istringstream from(text1);
+    std::istringstream to(text2);
+    std::ostringstream out;
+
+    // Правки редкие, окна синхронизируются на неизмененных строках, и число
+    // правок совпадает с diff целых файлов
+    REQUIRE_FALSE(streaming.Run(from, to, out));
+    MyersDiff whole(CreateTokenizer(UniversalTokenizerMode::WORD), text1, text2);
+
+    int distance = 0;
+    int hunks_count = 0;
+    count_changes(out.str(), distance, hunks_count);
+    REQUIRE(distance == whole.GetLevenshteinDistance());
+    REQUIRE(hunks_count == static_cast<int>(whole.GetShortestEditScript().size()));
+
+    std::istringstream same_from(text1);
+    std::istringstream same_to(text1);
+    std::ostringstream same_out;
+    REQUIRE(streaming.Run(same_from, same_to, same_out));
+    REQUIRE(same_out.str().empty());
+
+    SECTION("Edits longer than the window") {
+        // Вставка в 15 КБ на окна по 4 КБ: общих строк в паре окон нет, и окна
+        // синхронизируются на участке, найденном по хешам дальше в файлах
+        std::string inserted;
+        for (int i = 0; i < 1000; ++i) {
+            inserted += "added" + std::to_string(i) + " row\n";
+        }
+        size_t split = text1.find('\n', 2000) + 1;
+        std::string longer = text1.substr(0, split) + inserted + text1.substr(split);
+
+        StreamingDiffOptions long_options;
+        long_options.window_bytes = 4096;
+        StreamingDiff long_streaming(UniversalTokenizerMode::WHITESPACE, long_options);
+        for (auto [long_from, long_to] : {std::make_pair(text1, longer), std::make_pair(longer, text1)}) {
+            std::istringstream long_from_stream(long_from);
+            std::istringstream long_to_stream(long_to);
+            std::ostringstream long_out;
+            REQUIRE_FALSE(long_streaming.Run(long_from_stream, long_to_stream, long_out));
+
+            count_changes(long_out.str(), distance, hunks_count);
+            REQUIRE(distance == 2000);
+            REQUIRE(hunks_count == 1);
+        }
+    }
+}
+
+TEST_CASE("Distance without edit script", "[diff][distance]") {
+    std::string text1;
+    std::string text2;
+    for (int i = 0; i < 500; ++i) {
+        text1 += "a" + std::to_string(i * 7 % 31) + " ";
+        text2 += "a" + std::to_string(i * 5 % 29) + " ";
+    }
+
+    SECTION("Word tokens") {
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        REQUIRE(diff.ComputeEditDistance() == diff.GetLevenshteinDistance());
+    }
+
+    SECTION("Exact under a cost bound") {
+        MyersDiff exact(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        MyersDiffOptions options;
+        options.max_cost = 4;
+        MyersDiff bounded(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2, options);
+        REQUIRE(bounded.ComputeEditDistance() == exact.GetLevenshteinDistance());
+    }
+
+    SECTION("Characters through the bit-parallel kernel") {
+        MyersDiff exact(CreateTokenizer(UniversalTokenizerMode::CHARACTER), text1, text2);
+        MyersDiffOptions options;
+        options.algorithm = DiffAlgorithm::BIT_PARALLEL;
+        MyersDiff bit_parallel(CreateTokenizer(UniversalTokenizerMode::CHARACTER), text1, text2, options);
+        REQUIRE(bit_parallel.ComputeEditDistance() == exact.GetLevenshteinDistance());
+    }
+
+    SECTION("Identical texts") {
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text1);
+        REQUIRE(diff.ComputeEditDistance() == 0);
+        REQUIRE(diff.WithinDistance(0) == 0);
+    }
+
+    SECTION("Bounded query") {
+        MyersDiff diff(CreateTokenizer(UniversalTokenizerMode::WHITESPACE), text1, text2);
+        int distance = diff.GetLevenshteinDistance();
+        REQUIRE(diff.WithinDistance(distance) == distance);
+        REQUIRE(diff.WithinDistance(distance + 10) == distance);
+        REQUIRE_FALSE(diff.WithinDistance(distance - 1));
+        REQUIRE_FALSE(diff.WithinDistance(0));
+    }
+}
+
 TEST_CASE("Diff format output tests", "[diff][format]") {
     std::string text1 = "line1\nline2\nline3\n";
     std::string text2 = "line1\nmodified line\nline3\n";